@@ -37,16 +37,25 @@
 #ifndef IGNITION_BRIDGE_HPP_
 #define IGNITION_BRIDGE_HPP_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <vector>
 #include <iostream>
 
+#include <map>
+#include <mutex>
 #include <unordered_map>
 #include <as2_core/sensor.hpp>
 #include <as2_core/names/topics.hpp>
 #include <geometry_msgs/msg/pose_stamped.hpp>
 #include <geometry_msgs/msg/twist_stamped.hpp>
 #include <nav_msgs/msg/odometry.hpp>
+#include <rosgraph_msgs/msg/clock.hpp>
 #include "sensor_msgs/msg/nav_sat_fix.hpp"
 #include <tf2_msgs/msg/tf_message.h>
 
@@ -54,152 +63,316 @@
 #include <ignition/msgs.hh>
 #include <ros_ign_bridge/convert.hpp>
 
+#include "scan_projector.hpp"
+#include "sensor_channel.hpp"
+#include "sensor_stats.hpp"
+#include "stream_policy.hpp"
+#include "stream_recorder.hpp"
+
 namespace ignition_platform
 {
-    typedef void (*poseCallbackType)(geometry_msgs::msg::PoseStamped &msg);
-    typedef void (*odometryCallbackType)(nav_msgs::msg::Odometry &msg);
-
-    typedef void (*imuSensorCallbackType)(sensor_msgs::msg::Imu &msg);
-    typedef void (*airPressureSensorCallbackType)(sensor_msgs::msg::FluidPressure &msg);
-    typedef void (*magnetometerSensorCallbackType)(sensor_msgs::msg::MagneticField &msg);
-
-    typedef void (*tfCallbackType)(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
-    typedef void (*cameraCallbackType)(sensor_msgs::msg::Image &msg, const std::string &sensor_name);
-    typedef void (*cameraInfoCallbackType)(sensor_msgs::msg::CameraInfo &msg, const std::string &sensor_name);
-    typedef void (*laserScanCallbackType)(sensor_msgs::msg::LaserScan &msg, const std::string &sensor_name);
-    typedef void (*pointCloudCallbackType)(sensor_msgs::msg::PointCloud2 &msg, const std::string &sensor_name);
-    typedef void (*gpsCallbackType)(sensor_msgs::msg::NavSatFix &msg, const std::string &sensor_name);
-    typedef void (*imuCallbackType)(sensor_msgs::msg::Imu &msg, const std::string &sensor_name);
-    typedef void (*airPressureCallbackType)(sensor_msgs::msg::FluidPressure &msg, const std::string &sensor_name);
-    typedef void (*magnetometerCallbackType)(sensor_msgs::msg::MagneticField &msg, const std::string &sensor_name);
+    typedef std::function<void(geometry_msgs::msg::PoseStamped &msg)> poseCallbackType;
+    typedef std::function<void(nav_msgs::msg::Odometry &msg)> odometryCallbackType;
+    typedef std::function<void(rosgraph_msgs::msg::Clock &msg)> clockCallbackType;
+
+    typedef std::function<void(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name)> tfCallbackType;
 
+    // Bridge between one vehicle model and ROS. Unsubscribing a topic removes every handler an
+    // ignition node has on it, so each bridge subscribes through a node of its own and the bridges
+    // of many vehicles can share a process without unsubscribing each other.
     class IgnitionBridge
     {
     public:
-        IgnitionBridge(std::string name_space = "/");
-        ~IgnitionBridge(){};
+        // With a recorder, every message received from ignition is also recorded
+        IgnitionBridge(std::string name_space = "/", std::shared_ptr<StreamRecorder> recorder = nullptr,
+                       const ignition::transport::NodeOptions &node_options = ignition::transport::NodeOptions());
+        ~IgnitionBridge();
 
     public:
         std::shared_ptr<ignition::transport::Node> ign_node_ptr_;
-        ignition::transport::v11::Node::Publisher command_twist_pub_;
+        ignition::transport::Node::Publisher command_twist_pub_;
 
     private:
-        static std::string name_space_;
-
-        const std::string &ign_topic_command_twist_ = "/cmd_vel";
-        const std::string &ign_topic_sensor_pose_ = "/pose";
-        const std::string &ign_topic_sensor_pose_static_ = "/pose_static";
-        const std::string &ign_topic_sensor_odometry_ = "/odometry";
+        std::string name_space_;
+        std::vector<std::string> subscribed_topics_;
+        std::shared_ptr<StreamRecorder> recorder_;
+        size_t conversion_threads_ = 0;
+        std::unique_ptr<WorkerPool> worker_pool_;
+        WorkerPool &workerPool();
+
+        const std::string ign_topic_command_twist_ = "/cmd_vel";
+        const std::string ign_topic_sensor_pose_ = "/pose";
+        const std::string ign_topic_sensor_pose_static_ = "/pose_static";
+        const std::string ign_topic_sensor_odometry_ = "/odometry";
+        const std::string ign_topic_clock_ = "/clock";
 
     public:
         void sendTwistMsg(const geometry_msgs::msg::Twist &msg);
 
-        void unsuscribePoseStatic();
-
-        void setPoseCallback(poseCallbackType callback);
-        void setOdometryCallback(odometryCallbackType callback);
+        // Per-stream counters keyed by sensor name, with "/points" or "/camera_info" appended for
+        // the secondary stream of a sensor
+        const std::map<std::string, std::shared_ptr<SensorStats>> &getSensorStats() const { return sensor_stats_; };
 
-        void setImuCallback(imuSensorCallbackType callback, std::string world_name);
-        void setAirPressureCallback(airPressureSensorCallbackType callback, std::string world_name);
-        void setMagnetometerCallback(magnetometerSensorCallbackType callback, std::string world_name);
+        // Sensor transforms only need pose_static until every expected sensor has one
+        void subscribePoseStatic();
+        void unsuscribePoseStatic();
 
-        void addSensor(
-            std::string world_name,
-            std::string name_space,
-            std::string sensor_name,
-            std::string link_name,
-            std::string sensor_type,
-            cameraCallbackType cameraCallback,
-            cameraInfoCallbackType cameraInfoCallback,
-            tfCallbackType tfCallback);
+        // Camera and lidar streams are only subscribed on demand, using the same names as the
+        // stats. Returns true if the subscription changed.
+        bool setSensorDemand(const std::string &name, bool demand);
 
-        void addSensor(
-            std::string world_name,
-            std::string name_space,
-            std::string sensor_name,
-            std::string link_name,
-            std::string sensor_type,
-            laserScanCallbackType laserScanCallback,
-            pointCloudCallbackType pointCloudCallback,
-            tfCallbackType tfCallback);
+        // Threads converting camera and lidar messages, shared by all of them. Lightweight
+        // streams are converted inline on the ignition transport thread. At most one thread less
+        // than the cores is used, and with none, the default, cameras and lidars are converted
+        // inline too. Ignition only lends its messages, so a pool copies each of them once more.
+        // Takes effect if called before the first camera or lidar is added.
+        void setConversionThreads(size_t threads);
 
+        void setPoseCallback(poseCallbackType callback);
+        void setOdometryCallback(odometryCallbackType callback);
+        void setClockCallback(clockCallbackType callback);
+
+        // Sensor callbacks may be any callable taking the ROS message. Each stream gets a channel
+        // instantiated on the type of its callback, so the callback is inlined into the conversion.
+
+        // Sensors of the vehicle itself, attached to its base_link
+        template <typename Callback>
+        void setImuCallback(Callback callback, const std::string &world_name)
+        {
+            subscribeBaseLinkSensor<ignition::msgs::IMU>(std::move(callback), world_name, "imu_sensor", "imu");
+        };
+
+        template <typename Callback>
+        void setAirPressureCallback(Callback callback, const std::string &world_name)
+        {
+            subscribeBaseLinkSensor<ignition::msgs::FluidPressure>(std::move(callback), world_name, "air_pressure",
+                                                                   "air_pressure");
+        };
+
+        template <typename Callback>
+        void setMagnetometerCallback(Callback callback, const std::string &world_name)
+        {
+            subscribeBaseLinkSensor<ignition::msgs::Magnetometer>(std::move(callback), world_name, "magnetometer",
+                                                                  "magnetometer");
+        };
+
+        // Cameras
+        template <typename CameraCallback, typename CameraInfoCallback,
+                  typename = std::enable_if_t<std::is_invocable_v<CameraCallback &, sensor_msgs::msg::Image &>>>
         void addSensor(
-            std::string world_name,
-            std::string name_space,
-            std::string sensor_name,
-            std::string link_name,
-            std::string sensor_type,
-            gpsCallbackType gpsCallback,
-            tfCallbackType tfCallback);
-
+            const std::string &world_name,
+            const std::string &name_space,
+            const std::string &sensor_name,
+            const std::string &link_name,
+            const std::string &sensor_type,
+            CameraCallback cameraCallback,
+            CameraInfoCallback cameraInfoCallback,
+            tfCallbackType tfCallback,
+            const StreamPolicy &policy = StreamPolicy())
+        {
+            // The output buffer keeps its capacity between frames, so the pixels are copied only once
+            auto camera_channel =
+                makeSensorChannel<ignition::msgs::Image>(std::move(cameraCallback), addSensorStats(sensor_name));
+            auto camera_info_channel = makeSensorChannel<ignition::msgs::CameraInfo>(
+                std::move(cameraInfoCallback), addSensorStats(sensor_name + "/camera_info"));
+            addCameraStreams(
+                sensorTopic(world_name, name_space, sensor_name, link_name, sensor_type), sensor_name,
+                [camera_channel](const ignition::msgs::Image &msg)
+                { camera_channel->convert(msg); },
+                [camera_info_channel](const ignition::msgs::CameraInfo &msg)
+                { camera_info_channel->convert(msg); },
+                tfCallback, policy);
+        };
+
+        // Lidars
+        template <typename LaserScanCallback, typename PointCloudCallback,
+                  typename = std::enable_if_t<std::is_invocable_v<LaserScanCallback &, sensor_msgs::msg::LaserScan &>>>
         void addSensor(
-            std::string world_name,
-            std::string name_space,
-            std::string sensor_name,
-            std::string link_name,
-            std::string sensor_type,
-            imuCallbackType imuCallback,
-            tfCallbackType tfCallback);
-
+            const std::string &world_name,
+            const std::string &name_space,
+            const std::string &sensor_name,
+            const std::string &link_name,
+            const std::string &sensor_type,
+            LaserScanCallback laserScanCallback,
+            PointCloudCallback pointCloudCallback,
+            tfCallbackType tfCallback,
+            bool points_from_scan = false)
+        {
+            auto laser_scan_channel = makeSensorChannel<ignition::msgs::LaserScan>(std::move(laserScanCallback),
+                                                                                   addSensorStats(sensor_name));
+            auto point_cloud_stats = addSensorStats(sensor_name + "/points");
+            std::function<void(const ignition::msgs::LaserScan &)> project_points;
+            std::function<void(const ignition::msgs::PointCloudPacked &)> convert_points;
+            if (points_from_scan)
+            {
+                // Projected on the strand converting the scans, so the buffers need no lock
+                auto projector = std::make_shared<ScanProjector>();
+                auto point_cloud_msg = std::make_shared<sensor_msgs::msg::PointCloud2>();
+                project_points = [projector, point_cloud_msg, point_cloud_stats,
+                                  callback = std::move(pointCloudCallback)](const ignition::msgs::LaserScan &msg) mutable
+                { ignitionScanPointsCallback(msg, *projector, *point_cloud_msg, callback, *point_cloud_stats); };
+            }
+            else
+            {
+                auto point_cloud_channel = makeSensorChannel<ignition::msgs::PointCloudPacked>(
+                    std::move(pointCloudCallback), point_cloud_stats);
+                convert_points = [point_cloud_channel](const ignition::msgs::PointCloudPacked &msg)
+                { point_cloud_channel->convert(msg); };
+            }
+            addLidarStreams(
+                sensorTopic(world_name, name_space, sensor_name, link_name, sensor_type), sensor_name,
+                [laser_scan_channel](const ignition::msgs::LaserScan &msg)
+                { laser_scan_channel->convert(msg); },
+                std::move(project_points), std::move(convert_points), tfCallback);
+        };
+
+        // Sensors with a single stream. The ignition message type selects the conversion, the
+        // ROS message and the topic.
+        template <typename IgnMsgT, typename Callback>
         void addSensor(
-            std::string world_name,
-            std::string name_space,
-            std::string sensor_name,
-            std::string link_name,
-            std::string sensor_type,
-            airPressureCallbackType air_pressureCallback,
-            tfCallbackType tfCallback);
-
-        void addSensor(
-            std::string world_name,
-            std::string name_space,
-            std::string sensor_name,
-            std::string link_name,
-            std::string sensor_type,
-            magnetometerCallbackType magnetometerCallback,
-            tfCallbackType tfCallback);
+            const std::string &world_name,
+            const std::string &name_space,
+            const std::string &sensor_name,
+            const std::string &link_name,
+            const std::string &sensor_type,
+            Callback callback,
+            tfCallbackType tfCallback)
+        {
+            auto channel = makeSensorChannel<IgnMsgT>(std::move(callback), addSensorStats(sensor_name));
+            subscribe<IgnMsgT>(
+                sensorTopic(world_name, name_space, sensor_name, link_name, sensor_type) + SensorStream<IgnMsgT>::suffix,
+                [channel](const IgnMsgT &msg)
+                { (*channel)(msg); });
+            addTransformCallback(sensor_name, tfCallback);
+        };
 
     private:
-        // Ignition callbacks
-        static poseCallbackType poseCallback_;
-        static void ignitionPoseCallback(const ignition::msgs::Pose &msg);
-        static odometryCallbackType odometryCallback_;
-        static void ignitionOdometryCallback(const ignition::msgs::Odometry &msg);
-
-        static imuSensorCallbackType imuCallback_;
-        static void ignitionImuSensorCallback(const ignition::msgs::IMU &msg);
-        static airPressureSensorCallbackType airPressureCallback_;
-        static void ignitionAirPressureSensorCallback(const ignition::msgs::FluidPressure &msg);
-        static magnetometerSensorCallbackType magnetometerCallback_;
-        static void ignitionMagnetometerSensorCallback(const ignition::msgs::Magnetometer &msg);
-
-        static void ignitionPoseStaticCallback(const ignition::msgs::Pose_V &msg);
-
-        static std::unordered_map<std::string, std::string> callbacks_sensors_names_;
-        static std::unordered_map<std::string, tfCallbackType> callbacks_sensors_transform_;
-
-        static void ignitionCameraCallback(const ignition::msgs::Image &msg, const ignition::transport::MessageInfo &_info);
+        template <typename IgnMsgT, typename Callback>
+        void subscribeBaseLinkSensor(Callback callback, const std::string &world_name,
+                                     const std::string &sensor_name, const std::string &stats_name)
+        {
+            auto channel = makeSensorChannel<IgnMsgT>(std::move(callback), addSensorStats(stats_name));
+            subscribe<IgnMsgT>(baseLinkSensorTopic(world_name, sensor_name) + SensorStream<IgnMsgT>::suffix,
+                               [channel](const IgnMsgT &msg)
+                               { (*channel)(msg); });
+        };
+
+        // Subscriptions of the cameras and lidars, given the conversion of each stream. Messages are
+        // counted as received when they arrive and converted on the worker pool.
+        void addCameraStreams(const std::string &topic, const std::string &sensor_name,
+                              std::function<void(const ignition::msgs::Image &)> convertImage,
+                              std::function<void(const ignition::msgs::CameraInfo &)> convertCameraInfo,
+                              tfCallbackType tfCallback, const StreamPolicy &policy);
+        // Either the points are projected from the scan or they are converted from their own stream
+        void addLidarStreams(const std::string &topic, const std::string &sensor_name,
+                             std::function<void(const ignition::msgs::LaserScan &)> convertScan,
+                             std::function<void(const ignition::msgs::LaserScan &)> projectPoints,
+                             std::function<void(const ignition::msgs::PointCloudPacked &)> convertPoints,
+                             tfCallbackType tfCallback);
+
+        template <typename MessageT>
+        void subscribe(const std::string &topic, std::function<void(const MessageT &)> callback)
+        {
+            // Recorded before it is handled, so a replay goes through the same path
+            if (recorder_)
+            {
+                auto recorder = recorder_;
+                const uint16_t topic_id = recorder->addTopic(topic, MessageT().GetTypeName());
+                callback = [recorder, topic_id, callback](const MessageT &msg)
+                {
+                    recorder->record(topic_id, msg);
+                    callback(msg);
+                };
+            }
+            ign_node_ptr_->Subscribe(topic, callback);
+            subscribed_topics_.emplace_back(topic);
+        };
+
+        void unsubscribe(const std::string &topic);
+
+        // Topic prefix of a sensor, the suffix of each stream comes from its SensorStream
+        static std::string sensorTopic(const std::string &world_name, const std::string &model_name,
+                                       const std::string &sensor_name, const std::string &link_name,
+                                       const std::string &sensor_type);
+        std::string baseLinkSensorTopic(const std::string &world_name, const std::string &sensor_name) const;
+
+        struct OnDemandSubscription
+        {
+            std::function<void(bool)> activate;
+            bool active = false;
+        };
+        std::map<std::string, OnDemandSubscription> on_demand_subscriptions_;
+
+        template <typename MessageT>
+        void subscribeOnDemand(const std::string &name, const std::string &topic,
+                               std::function<void(const MessageT &)> callback)
+        {
+            OnDemandSubscription subscription;
+            subscription.activate = [this, topic, callback](bool active)
+            {
+                if (active)
+                {
+                    subscribe(topic, callback);
+                }
+                else
+                {
+                    unsubscribe(topic);
+                }
+            };
+            on_demand_subscriptions_.emplace(name, subscription);
+        };
+
+        // Streams computed from another subscription only need to be switched on
+        void addDerivedStream(const std::string &name, std::shared_ptr<std::atomic<bool>> enabled);
+
+        std::map<std::string, std::shared_ptr<SensorStats>> sensor_stats_;
+        std::shared_ptr<SensorStats> addSensorStats(const std::string &name);
+        std::shared_ptr<SensorStats> pose_stats_;
+        std::shared_ptr<SensorStats> odometry_stats_;
+
+        // Conversion buffers, each only used by the thread delivering its stream so that the
+        // strings and vectors inside keep their storage between messages
+        geometry_msgs::msg::PoseStamped pose_msg_;
+        nav_msgs::msg::Odometry odometry_msg_;
+        ignition::msgs::Twist command_twist_msg_;
 
-        static std::unordered_map<std::string, cameraCallbackType> callbacks_camera_;
-        static void ignitionCameraInfoCallback(const ignition::msgs::CameraInfo &msg, const ignition::transport::MessageInfo &_info);
-        static std::unordered_map<std::string, cameraInfoCallbackType> callbacks_camera_info_;
-
-        static void ignitionLaserScanCallback(const ignition::msgs::LaserScan &msg, const ignition::transport::MessageInfo &_info);
-        static std::unordered_map<std::string, laserScanCallbackType> callbacks_laser_scan_;
-        static void ignitionPointCloudCallback(const ignition::msgs::PointCloudPacked &msg, const ignition::transport::MessageInfo &_info);
-        static std::unordered_map<std::string, pointCloudCallbackType> callbacks_point_cloud_;
-
-        static void ignitionGPSCallback(const ignition::msgs::NavSat &msg, const ignition::transport::MessageInfo &_info);
-        static std::unordered_map<std::string, gpsCallbackType> callbacks_gps_;
-
-        static void ignitionImuCallback(const ignition::msgs::IMU &msg, const ignition::transport::MessageInfo &_info);
-        static std::unordered_map<std::string, imuCallbackType> callbacks_imu_;
-
-        static void ignitionAirPressureCallback(const ignition::msgs::FluidPressure &msg, const ignition::transport::MessageInfo &_info);
-        static std::unordered_map<std::string, airPressureCallbackType> callbacks_air_pressure_;
-
-        static void ignitionMagnometerCallback(const ignition::msgs::Magnetometer &msg, const ignition::transport::MessageInfo &_info);
-        static std::unordered_map<std::string, magnetometerCallbackType> callbacks_magnetometer_;
+        // Ignition callbacks
+        poseCallbackType poseCallback_;
+        void ignitionPoseCallback(const ignition::msgs::Pose &msg);
+        odometryCallbackType odometryCallback_;
+        void ignitionOdometryCallback(const ignition::msgs::Odometry &msg);
+        clockCallbackType clockCallback_;
+        void ignitionClockCallback(const ignition::msgs::Clock &msg);
+
+        void ignitionPoseStaticCallback(const ignition::msgs::Pose_V &msg);
+
+        // Sensors can be added at runtime while pose_static is being dispatched
+        std::mutex transform_mutex_;
+        std::unordered_map<std::string, tfCallbackType> callbacks_sensors_transform_;
+        void addTransformCallback(const std::string &sensor_name, tfCallbackType poseStaticCallback);
+        std::atomic<uint64_t> transform_callbacks_version_{0};
+        bool pose_static_subscribed_ = false;
+
+        // Last static pose of each entity, only used by the pose_static callback
+        std::unordered_map<std::string, std::array<double, 7>> static_poses_;
+        uint64_t static_poses_version_ = 0;
+
+        // The points of a lidar projected from its scan
+        template <typename Callback>
+        static void ignitionScanPointsCallback(const ignition::msgs::LaserScan &msg,
+                                               ScanProjector &projector,
+                                               sensor_msgs::msg::PointCloud2 &ros_msg,
+                                               Callback &callback,
+                                               SensorStats &stats)
+        {
+            // Nothing extra was transported for this stream
+            stats.recordReceived(0);
+            auto start = SensorStats::Clock::now();
+            projector.project(msg, ros_msg);
+            auto converted = SensorStats::Clock::now();
+            callback(ros_msg);
+            stats.recordPublished(start, converted, SensorStats::Clock::now());
+        };
     };
 }
 
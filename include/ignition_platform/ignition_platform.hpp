@@ -41,9 +41,11 @@
 #include <string>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <rclcpp/logging.hpp>
 
 #include <unordered_map>
+#include <unordered_set>
 #include <Eigen/Dense>
 #include <Eigen/src/Core/Matrix.h>
 #include <math.h>
@@ -58,6 +60,7 @@
 #include <geometry_msgs/msg/transform_stamped.hpp>
 #include <geometry_msgs/msg/transform.hpp>
 #include <nav_msgs/msg/odometry.hpp>
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include <image_transport/image_transport.hpp>
 #include "sensor_msgs/msg/nav_sat_fix.hpp"
@@ -68,17 +71,60 @@
 #include <tf2_ros/transform_listener.h>
 
 #include "ignition_bridge.hpp"
-
-#define CMD_FREQ 10  // miliseconds
+#include "image_pipeline.hpp"
+#include "latency_histogram.hpp"
+#include "point_cloud_filter.hpp"
+#include "sensor_discovery.hpp"
+#include "sensor_sync.hpp"
+#include "state_buffer.hpp"
+#include "stream_recorder.hpp"
 
 namespace ignition_platform
 {
     using Vector3d = Eigen::Vector3d;
 
+    // Latest vehicle state, handed from the odometry callback to the command timer
+    struct VehicleState
+    {
+        double position[3];
+        double orientation[4];  // x, y, z, w
+        double linear_velocity[3];
+        double angular_velocity[3];
+        int32_t stamp_sec;
+        uint32_t stamp_nanosec;
+    };
+
+    // Sensor counters at the previous diagnostics report, used to compute rates
+    struct StatsSnapshot
+    {
+        uint64_t received = 0;
+        uint64_t published = 0;
+        uint64_t dropped = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Image payloads are published straight from the bridge buffers, bypassing the copy made by
+    // as2::sensors::Camera::updateData.
+    struct CameraPublishers
+    {
+        rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_pub;
+        rclcpp::Publisher<sensor_msgs::msg::CameraInfo>::SharedPtr camera_info_pub;
+        sensor_msgs::msg::CameraInfo camera_info;
+        bool camera_info_received = false;
+        // Images may be converted on their own thread while camera_info arrives
+        std::shared_ptr<std::mutex> camera_info_mutex = std::make_shared<std::mutex>();
+        // Optional crop, conversion and pyramid, with one publisher per pyramid level
+        std::shared_ptr<ImagePipeline> pipeline;
+        std::vector<rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr> level_pubs;
+        std::string frame_id;
+        // Feeds the bundles the camera belongs to, if any
+        std::function<void(const sensor_msgs::msg::Image &)> bundle;
+    };
+
     class IgnitionPlatform : public as2::AerialPlatform
     {
     public:
-        IgnitionPlatform();
+        IgnitionPlatform(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
         ~IgnitionPlatform(){};
 
     public:
@@ -89,54 +135,156 @@ namespace ignition_platform
         bool ownSetOffboardControl(bool offboard) override;
         bool ownSetPlatformControlMode(const as2_msgs::msg::ControlMode &msg) override;
 
-        static std::unique_ptr<as2::sensors::Sensor<geometry_msgs::msg::PoseStamped>> pose_ptr_;
-        static void poseCallback(geometry_msgs::msg::PoseStamped &msg);
+        rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr pose_pub_;
+        void poseCallback(geometry_msgs::msg::PoseStamped &msg);
         
-        static std::unordered_map<std::string, bool> callbacks_tf_;
-        static void poseStaticCallback(tf2_msgs::msg::TFMessage &msg);
-        static bool checkTf(const std::string &sensor_name);
+        std::unordered_map<std::string, bool> callbacks_tf_;
+        // Cameras and lidars only have plain publishers, so their transforms are sent from here
+        std::shared_ptr<tf2_ros::StaticTransformBroadcaster> static_tf_broadcaster_;
+        void sendStaticTransforms(std::vector<geometry_msgs::msg::TransformStamped> transforms);
+        void poseStaticCallback(tf2_msgs::msg::TFMessage &msg);
+        bool checkTf(const std::string &sensor_name);
 
-        static std::unique_ptr<as2::sensors::Sensor<nav_msgs::msg::Odometry>> odometry_raw_estimation_ptr_;
-        static void odometryCallback(nav_msgs::msg::Odometry &msg);
+        rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr odometry_pub_;
+        void odometryCallback(nav_msgs::msg::Odometry &msg);
 
-        static std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::Imu>> imu_ptr_;
-        static void imuSensorCallback(sensor_msgs::msg::Imu &msg);
+        std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::Imu>> imu_ptr_;
+        void imuSensorCallback(sensor_msgs::msg::Imu &msg);
 
-        static std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::FluidPressure>> air_pressure_ptr_;
-        static void airPressureSensorCallback(sensor_msgs::msg::FluidPressure &msg);
+        std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::FluidPressure>> air_pressure_ptr_;
+        void airPressureSensorCallback(sensor_msgs::msg::FluidPressure &msg);
 
-        static std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::MagneticField>> magnetometer_ptr_;
-        static void magnetometerSensorCallback(sensor_msgs::msg::MagneticField &msg);
+        std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::MagneticField>> magnetometer_ptr_;
+        void magnetometerSensorCallback(sensor_msgs::msg::MagneticField &msg);
 
-        static std::unordered_map<std::string, as2::sensors::Camera> callbacks_camera_;
-        static void cameraCallback(sensor_msgs::msg::Image &msg, const std::string &sensor_name);
-        static void cameraInfoCallback(sensor_msgs::msg::CameraInfo &msg, const std::string &sensor_name);
-        static void cameraTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
+        std::unordered_map<std::string, CameraPublishers> camera_publishers_;
+        void cameraCallback(sensor_msgs::msg::Image &msg, CameraPublishers &publishers);
+        void cameraInfoCallback(sensor_msgs::msg::CameraInfo &msg, CameraPublishers &publishers);
+        void cameraTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
 
-        static std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::LaserScan>> callbacks_laser_scan_;
-        static void laserScanCallback(sensor_msgs::msg::LaserScan &msg, const std::string &sensor_name);
-        static std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::PointCloud2>> callbacks_point_cloud_;
-        static void pointCloudCallback(sensor_msgs::msg::PointCloud2 &msg, const std::string &sensor_name);
-        static void lidarTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
+        std::unordered_map<std::string, rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr> laser_scan_publishers_;
+        void laserScanCallback(sensor_msgs::msg::LaserScan &msg, rclcpp::Publisher<sensor_msgs::msg::LaserScan> &publisher, const std::string &frame_id,
+                               const std::function<void(const sensor_msgs::msg::LaserScan &)> &bundle);
+        std::unordered_map<std::string, rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr> point_cloud_publishers_;
+        std::unordered_set<std::string> points_from_scan_;
+        // Keyed by stats name, "<sensor_name>/points"
+        std::unordered_map<std::string, std::shared_ptr<PointCloudFilter>> point_cloud_filters_;
+        void pointCloudCallback(sensor_msgs::msg::PointCloud2 &msg, rclcpp::Publisher<sensor_msgs::msg::PointCloud2> &publisher, PointCloudFilter *filter, const std::string &frame_id,
+                                const std::function<void(const sensor_msgs::msg::PointCloud2 &)> &bundle);
+        void lidarTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
 
-        static std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::NavSatFix>> callbacks_gps_;
-        static void gpsCallback(sensor_msgs::msg::NavSatFix &msg, const std::string &sensor_name);
-        static void gpsTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
+        std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::NavSatFix>> callbacks_gps_;
+        void gpsCallback(sensor_msgs::msg::NavSatFix &msg, as2::sensors::Sensor<sensor_msgs::msg::NavSatFix> &sensor);
+        void gpsTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
 
-        static std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::Imu>> callbacks_imu_;
-        static void imuCallback(sensor_msgs::msg::Imu &msg, const std::string &sensor_name);
-        static void imuTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
+        std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::Imu>> callbacks_imu_;
+        void imuCallback(sensor_msgs::msg::Imu &msg, as2::sensors::Sensor<sensor_msgs::msg::Imu> &sensor, const std::string &frame_id);
+        void imuTFCallback(geometry_msgs::msg::TransformStamped &msg, const std::string &sensor_name);
 
     private:
-        static std::shared_ptr<IgnitionBridge> ignition_bridge_;
-        static bool odometry_info_received_;
+        std::shared_ptr<StreamRecorder> recorder_;
+        std::shared_ptr<IgnitionBridge> ignition_bridge_;
+        // Declared after the bridge so that playback stops before the bridge goes away
+        std::unique_ptr<StreamReplay> replay_;
+        rclcpp::CallbackGroup::SharedPtr sensor_callback_group_;
+        rclcpp::CallbackGroup::SharedPtr report_callback_group_;
+        StateBuffer<VehicleState> vehicle_state_;
+        uint64_t last_vehicle_state_sequence_ = 0;
         as2_msgs::msg::ControlMode control_in_;
-        static geometry_msgs::msg::Quaternion self_orientation_;
         double yaw_rate_limit_ = M_PI_2;
-        static std::string namespace_;
+        std::string namespace_;
+        // Frame ids resolved once against namespace_ instead of on every message
+        std::string odom_frame_id_;
+        std::string imu_frame_id_;
+        std::string air_pressure_frame_id_;
+        std::string magnetometer_frame_id_;
+        rclcpp::TimerBase::SharedPtr timer_commands_;
+        rclcpp::Publisher<rosgraph_msgs::msg::Clock>::SharedPtr clock_pub_;
+
+        bool event_driven_commands_ = false;
+        // Only in event driven mode, next to the subscription of as2::AerialPlatform
+        rclcpp::Subscription<geometry_msgs::msg::TwistStamped>::SharedPtr twist_command_sub_;
+
+        bool command_pending_ = false;
+        std::chrono::steady_clock::time_point command_received_time_;
+        LatencyHistogram command_latency_;
+        rclcpp::TimerBase::SharedPtr timer_latency_report_;
+
+        rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_pub_;
+        rclcpp::TimerBase::SharedPtr timer_stats_;
+        std::unordered_map<std::string, StatsSnapshot> last_stats_;
+        std::chrono::steady_clock::time_point last_stats_time_ = std::chrono::steady_clock::now();
+
+        // Guards the sensor maps, written from the sensor callback group and read from pose_static
+        std::mutex sensors_mutex_;
+        std::unordered_set<std::string> configured_sensors_;
+        bool world_configured_ = false;
+        std::unique_ptr<SensorDiscovery> sensor_discovery_;
+        std::chrono::steady_clock::time_point start_time_ = std::chrono::steady_clock::now();
+        bool first_sensor_message_reported_ = false;
+        bool lazy_subscriptions_ = true;
+        std::chrono::steady_clock::duration static_tf_timeout_;
+        std::chrono::steady_clock::time_point static_tf_deadline_;
+        // Discovery, static transforms and sensor demand at platform_freq
+        rclcpp::TimerBase::SharedPtr timer_platform_;
 
     private:
+        static constexpr double kDefaultCmdFreq = 100.0;
+        static constexpr double kDefaultPlatformFreq = 60.0;
+        // Rate parameter of a timer, or its default if it is not positive
+        double timerRate(const std::string &name, double default_rate);
+
         void resetCommandTwistMsg();
+        bool forwardTwist(const geometry_msgs::msg::Twist &command_twist);
+        void twistCommandCallback(const geometry_msgs::msg::TwistStamped::SharedPtr msg);
+        void reportCommandLatency();
+        void publishSensorStats();
+        bool addSensor(const SensorConfig &config);
+        // Only written while configuring the sensors, the feeds keep their bundle alive
+        std::vector<std::shared_ptr<SensorBundle>> bundles_;
+        // Sensors feeding some bundle, bridged whether or not the bundles have subscribers
+        std::unordered_set<std::string> bundled_sensors_;
+        void configureBundles();
+        // Feeds the messages of a sensor into every bundle it belongs to, empty if none. Bundles
+        // carry the messages as converted, before any image pipeline or point cloud filter.
+        template <typename MessageT>
+        std::function<void(const MessageT &)> bundleFeed(const std::string &sensor_name,
+                                                         const std::string &topic_suffix = "");
+        void configureWorld(const std::string &world_name);
+        void platformLoop();
+        void processDiscoveredSensors();
+        void checkStaticTransforms();
+        void updateSensorDemand();
+        void setSensorDemand(const std::string &name, bool demand);
+
+        // Intra-process subscribers take ownership of the message, so the conversion buffer is
+        // moved into it and regrows on the next message. Otherwise it is published by
+        // reference and reused.
+        template <typename MessageT>
+        void publishMessage(rclcpp::Publisher<MessageT> &publisher, MessageT &msg)
+        {
+            if (publisher.get_intra_process_subscription_count() > 0)
+            {
+                publisher.publish(std::make_unique<MessageT>(std::move(msg)));
+                return;
+            }
+            publisher.publish(msg);
+        };
+
+        // QoS of the publishers of a sensor, from the defaults of its type overridden by
+        // "qos.<sensor_type>.{reliability,depth,durability}" and then by "<sensor_name>.qos.*"
+        rclcpp::QoS sensorQoS(const std::string &sensor_type, const std::string &sensor_name);
+
+        // Sensors are added at runtime, so their parameters are declared on first use
+        template <typename ParameterT>
+        ParameterT sensorParameter(const std::string &name, const ParameterT &default_value)
+        {
+            if (!this->has_parameter(name))
+            {
+                return this->declare_parameter<ParameterT>(name, default_value);
+            }
+            return this->get_parameter(name).get_value<ParameterT>();
+        };
     };
 }
 
@@ -0,0 +1,66 @@
+/*!*******************************************************************************************
+ *  \file       image_kernels.hpp
+ *  \brief      Vectorized pixel format conversion and downscaling kernels
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef IMAGE_KERNELS_HPP_
+#define IMAGE_KERNELS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ignition_platform
+{
+    // Row kernels for 8 bit images. The vectorized variants are picked once at runtime from the
+    // features of the CPU (AVX2, then SSSE3), with a scalar fallback elsewhere.
+    namespace image_kernels
+    {
+        // Swaps the first and third channel of packed 3 channel pixels, rgb8 <-> bgr8
+        void swapRedBlue(const uint8_t *src, uint8_t *dst, size_t pixels);
+
+        // ITU-R BT.601 luma of packed rgb8 pixels, in 8 bit fixed point
+        void rgbToMono(const uint8_t *src, uint8_t *dst, size_t pixels);
+
+        // Halves an image with a rounded 2x2 box filter. width and height are those of the
+        // source, odd trailing columns and rows are ignored.
+        void downscale2x(const uint8_t *src, size_t src_step,
+                         uint8_t *dst, size_t dst_step,
+                         size_t width, size_t height, size_t channels);
+
+        // Name of the instruction set used by the kernels
+        const char *instructionSet();
+    }
+}
+
+#endif // IMAGE_KERNELS_HPP_
@@ -0,0 +1,87 @@
+/*!*******************************************************************************************
+ *  \file       image_pipeline.hpp
+ *  \brief      Camera frame crop, conversion and pyramid stage
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef IMAGE_PIPELINE_HPP_
+#define IMAGE_PIPELINE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/msg/camera_info.hpp>
+#include <sensor_msgs/msg/image.hpp>
+
+namespace ignition_platform
+{
+    struct ImagePipelineOptions
+    {
+        // Output encoding, "bgr8" or "mono8" from rgb8 sources, empty to keep the source one
+        std::string encoding;
+        // x, y, width and height of the published region, empty for the whole image
+        std::vector<int64_t> roi;
+        // 1 adds a half resolution image, 2 a quarter resolution one too
+        int64_t pyramid_levels = 0;
+    };
+
+    // Optional processing of camera frames before they are published: region of interest crop,
+    // pixel format conversion and downscaled pyramid levels. It works on 8 bit images and
+    // keeps its output buffers between frames.
+    class ImagePipeline
+    {
+    public:
+        explicit ImagePipeline(const ImagePipelineOptions &options);
+
+        bool enabled() const;
+
+        // Returns the processed frame, which is the input itself when it needs no change, or
+        // nullptr for frames that are not 8 bit, leaving the levels untouched. The levels are
+        // already computed, so the frame may be moved from and its buffer regrows on the next one.
+        sensor_msgs::msg::Image *process(sensor_msgs::msg::Image &input);
+
+        size_t levels() const { return levels_.size(); };
+        const sensor_msgs::msg::Image &level(size_t index) const { return levels_[index]; };
+
+        // Moves the principal point and size to the cropped region
+        void adjustCameraInfo(sensor_msgs::msg::CameraInfo &info) const;
+
+    private:
+        ImagePipelineOptions options_;
+        sensor_msgs::msg::Image output_;
+        std::vector<sensor_msgs::msg::Image> levels_;
+    };
+}
+
+#endif // IMAGE_PIPELINE_HPP_
@@ -0,0 +1,135 @@
+/*!*******************************************************************************************
+ *  \file       latency_histogram.hpp
+ *  \brief      Fixed size log-linear latency histogram
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef LATENCY_HISTOGRAM_HPP_
+#define LATENCY_HISTOGRAM_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ignition_platform
+{
+    // Latency histogram with 8 linear sub-buckets per power of two (relative error below 12.5 %).
+    // Recording is a handful of relaxed atomic increments and never allocates.
+    class LatencyHistogram
+    {
+    public:
+        LatencyHistogram() { reset(); };
+
+        void record(uint64_t value_ns)
+        {
+            buckets_[index(value_ns)].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            uint64_t max = max_.load(std::memory_order_relaxed);
+            while (value_ns > max &&
+                   !max_.compare_exchange_weak(max, value_ns, std::memory_order_relaxed))
+            {
+            }
+        };
+
+        // Upper bound of the bucket holding the given percentile (0-100), in nanoseconds
+        uint64_t percentile(double percent) const
+        {
+            const uint64_t total = count();
+            if (total == 0)
+            {
+                return 0;
+            }
+            uint64_t target = static_cast<uint64_t>(percent / 100.0 * total + 0.5);
+            target = target == 0 ? 1 : target;
+
+            uint64_t accumulated = 0;
+            for (size_t i = 0; i < kBuckets; i++)
+            {
+                accumulated += buckets_[i].load(std::memory_order_relaxed);
+                if (accumulated >= target)
+                {
+                    return upperBound(i);
+                }
+            }
+            return max();
+        };
+
+        uint64_t count() const { return count_.load(std::memory_order_relaxed); };
+        uint64_t max() const { return max_.load(std::memory_order_relaxed); };
+
+        void reset()
+        {
+            for (auto &bucket : buckets_)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            count_.store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        };
+
+    private:
+        static constexpr size_t kSubBucketBits = 3;
+        static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+        static constexpr size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+        static size_t index(uint64_t value)
+        {
+            if (value < kSubBuckets)
+            {
+                return value;
+            }
+            const size_t power = 63 - __builtin_clzll(value);
+            const size_t sub_bucket = (value >> (power - kSubBucketBits)) & (kSubBuckets - 1);
+            return (power - kSubBucketBits + 1) * kSubBuckets + sub_bucket;
+        };
+
+        static uint64_t upperBound(size_t index)
+        {
+            if (index < kSubBuckets)
+            {
+                return index;
+            }
+            const size_t power = index / kSubBuckets + kSubBucketBits - 1;
+            const uint64_t width = uint64_t(1) << (power - kSubBucketBits);
+            const uint64_t lower = (kSubBuckets + index % kSubBuckets) * width;
+            return lower + width - 1;
+        };
+
+        std::array<std::atomic<uint64_t>, kBuckets> buckets_;
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> max_;
+    };
+}
+
+#endif // LATENCY_HISTOGRAM_HPP_
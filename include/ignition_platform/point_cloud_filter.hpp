@@ -0,0 +1,119 @@
+/*!*******************************************************************************************
+ *  \file       point_cloud_filter.hpp
+ *  \brief      Voxel grid and random downsampling of lidar point clouds
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef POINT_CLOUD_FILTER_HPP_
+#define POINT_CLOUD_FILTER_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/msg/point_cloud2.hpp>
+
+#include "latency_histogram.hpp"
+
+namespace ignition_platform
+{
+    struct PointCloudFilterOptions
+    {
+        // "voxel", "random" or empty for no filtering
+        std::string type;
+        // Voxel edge in meters
+        double leaf_size = 0.1;
+        // Fraction of the points kept by the random filter
+        double keep_ratio = 0.1;
+    };
+
+    // Downsamples float32 xyz clouds before they are published. The voxel grid keeps one point
+    // per occupied voxel, at the centroid of its points and with the remaining fields of the
+    // first one. Voxels live in an open addressing table whose slots are invalidated by a
+    // generation counter. The table, the centroid sums and the output only grow, so once the
+    // largest frame has been seen nothing is zero filled or reallocated. Non finite points, and
+    // points more than 2^20 leaves away from the sensor, are discarded.
+    class PointCloudFilter
+    {
+    public:
+        explicit PointCloudFilter(const PointCloudFilterOptions &options);
+
+        // Smaller voxels would hold a single point of a simulated lidar, at a higher cost than
+        // publishing the cloud unfiltered
+        static constexpr double kMinLeafSize = 0.001;
+        static bool validLeafSize(double leaf_size);
+
+        bool enabled() const { return type_ != Type::NONE; };
+
+        // Returns the input itself if it has no float32 x, y and z fields
+        const sensor_msgs::msg::PointCloud2 &apply(const sensor_msgs::msg::PointCloud2 &input);
+
+        // Size of the last frame, and time spent filtering since the last reset
+        std::atomic<uint64_t> input_points{0};
+        std::atomic<uint64_t> output_points{0};
+        LatencyHistogram filter_time;
+
+    private:
+        enum class Type
+        {
+            NONE,
+            VOXEL,
+            RANDOM
+        };
+
+        struct Slot
+        {
+            uint64_t key;
+            uint32_t generation;
+            uint32_t index;
+        };
+
+        size_t voxelGrid(const sensor_msgs::msg::PointCloud2 &input, size_t points,
+                         uint32_t x_offset, uint32_t y_offset, uint32_t z_offset);
+        size_t randomSubsample(const sensor_msgs::msg::PointCloud2 &input, size_t points,
+                               uint32_t x_offset, uint32_t y_offset, uint32_t z_offset);
+
+        Type type_ = Type::NONE;
+        float inverse_leaf_size_;
+        uint64_t keep_threshold_;
+        uint64_t random_state_ = 0x9E3779B97F4A7C15ULL;
+
+        std::vector<Slot> slots_;
+        uint32_t generation_ = 0;
+        std::vector<float> sums_;
+        sensor_msgs::msg::PointCloud2 output_;
+    };
+}
+
+#endif // POINT_CLOUD_FILTER_HPP_
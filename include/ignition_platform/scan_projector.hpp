@@ -0,0 +1,80 @@
+/*!*******************************************************************************************
+ *  \file       scan_projector.hpp
+ *  \brief      Lidar point cloud projection from laser scans
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef SCAN_PROJECTOR_HPP_
+#define SCAN_PROJECTOR_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include <ignition/msgs.hh>
+#include <sensor_msgs/msg/point_cloud2.hpp>
+
+namespace ignition_platform
+{
+    // Builds the organized point cloud of a lidar from its scan, so only /scan has to cross
+    // ignition transport. Ray directions are cached and only rebuilt when the scan geometry
+    // changes, which leaves one multiplication per coordinate for each range.
+    //
+    // The cloud has the layout of the one published by the gpu_lidar sensor: 32 byte points with
+    // float32 x, y and z at 0, 4 and 8, float32 intensity at 16 and the uint16 ring, the vertical
+    // ray index, at 20. Points are row major, one row per vertical ray. Rays without a return
+    // multiply their infinite range like any other, so they give infinite coordinates, or NaN
+    // for a null direction component. Rays missing from a short scan are infinite. is_dense is
+    // always false.
+    class ScanProjector
+    {
+    public:
+        void project(const ignition::msgs::LaserScan &scan, sensor_msgs::msg::PointCloud2 &cloud);
+
+    private:
+        void updateDirections(const ignition::msgs::LaserScan &scan);
+
+        // Geometry the directions were computed for
+        double angle_min_ = 0.0;
+        double angle_step_ = 0.0;
+        uint32_t count_ = 0;
+        double vertical_angle_min_ = 0.0;
+        double vertical_angle_step_ = 0.0;
+        uint32_t vertical_count_ = 0;
+
+        std::vector<float> direction_x_;
+        std::vector<float> direction_y_;
+        std::vector<float> direction_z_;
+    };
+}
+
+#endif // SCAN_PROJECTOR_HPP_
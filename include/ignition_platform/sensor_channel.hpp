@@ -0,0 +1,179 @@
+/*!*******************************************************************************************
+ *  \file       sensor_channel.hpp
+ *  \brief      Typed conversion of one ignition sensor stream into ROS
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef SENSOR_CHANNEL_HPP_
+#define SENSOR_CHANNEL_HPP_
+
+#include <memory>
+#include <utility>
+
+#include <ignition/msgs.hh>
+#include <ros_ign_bridge/convert.hpp>
+#include <sensor_msgs/msg/camera_info.hpp>
+#include <sensor_msgs/msg/fluid_pressure.hpp>
+#include <sensor_msgs/msg/image.hpp>
+#include <sensor_msgs/msg/imu.hpp>
+#include <sensor_msgs/msg/laser_scan.hpp>
+#include <sensor_msgs/msg/magnetic_field.hpp>
+#include <sensor_msgs/msg/nav_sat_fix.hpp>
+#include <sensor_msgs/msg/point_cloud2.hpp>
+
+#include "sensor_stats.hpp"
+
+namespace ignition_platform
+{
+    // Streams whose conversion is provided by ros_ign_bridge
+    template <typename RosMsgT>
+    struct BridgedStream
+    {
+        using RosMsg = RosMsgT;
+
+        template <typename IgnMsgT>
+        static void convert(const IgnMsgT &msg, RosMsg &ros_msg)
+        {
+            ros_ign_bridge::convert_ign_to_ros(msg, ros_msg);
+        };
+    };
+
+    // Maps each ignition sensor message to its ROS message, its conversion and the suffix of its
+    // topic after ".../sensor/<sensor_type>". Supporting a new sensor message only needs a new
+    // specialization.
+    template <typename IgnMsgT>
+    struct SensorStream;
+
+    template <>
+    struct SensorStream<ignition::msgs::Image> : BridgedStream<sensor_msgs::msg::Image>
+    {
+        static constexpr const char *suffix = "/image";
+    };
+
+    template <>
+    struct SensorStream<ignition::msgs::CameraInfo> : BridgedStream<sensor_msgs::msg::CameraInfo>
+    {
+        static constexpr const char *suffix = "/camera_info";
+    };
+
+    template <>
+    struct SensorStream<ignition::msgs::LaserScan> : BridgedStream<sensor_msgs::msg::LaserScan>
+    {
+        static constexpr const char *suffix = "/scan";
+    };
+
+    template <>
+    struct SensorStream<ignition::msgs::PointCloudPacked> : BridgedStream<sensor_msgs::msg::PointCloud2>
+    {
+        static constexpr const char *suffix = "/scan/points";
+
+        // convert_ign_to_ros appends the fields, so a reused cloud has to start without them
+        static void convert(const ignition::msgs::PointCloudPacked &msg, RosMsg &ros_msg)
+        {
+            ros_msg.fields.clear();
+            BridgedStream<RosMsg>::convert(msg, ros_msg);
+        };
+    };
+
+    template <>
+    struct SensorStream<ignition::msgs::IMU> : BridgedStream<sensor_msgs::msg::Imu>
+    {
+        static constexpr const char *suffix = "/imu";
+    };
+
+    template <>
+    struct SensorStream<ignition::msgs::FluidPressure> : BridgedStream<sensor_msgs::msg::FluidPressure>
+    {
+        static constexpr const char *suffix = "/air_pressure";
+    };
+
+    template <>
+    struct SensorStream<ignition::msgs::Magnetometer> : BridgedStream<sensor_msgs::msg::MagneticField>
+    {
+        static constexpr const char *suffix = "/magnetometer";
+    };
+
+    // ros_ign_bridge has no NavSat conversion
+    template <>
+    struct SensorStream<ignition::msgs::NavSat>
+    {
+        using RosMsg = sensor_msgs::msg::NavSatFix;
+        static constexpr const char *suffix = "/navsat";
+        static void convert(const ignition::msgs::NavSat &msg, RosMsg &ros_msg);
+    };
+
+    // Converts one sensor stream into a ROS message that is reused between messages and hands it
+    // to the callback. The conversion and the callback are resolved at compile time, so the only
+    // indirection left is the one ignition transport makes to reach the channel.
+    template <typename IgnMsgT, typename Callback>
+    class SensorChannel
+    {
+    public:
+        using Stream = SensorStream<IgnMsgT>;
+
+        SensorChannel(Callback callback, std::shared_ptr<SensorStats> stats)
+            : callback_(std::move(callback)), stats_(std::move(stats)){};
+
+        void operator()(const IgnMsgT &msg)
+        {
+            stats_->recordReceived(msg.ByteSizeLong());
+            convert(msg);
+        };
+
+        // For handlers that already counted the message as received
+        void convert(const IgnMsgT &msg)
+        {
+            auto start = SensorStats::Clock::now();
+            Stream::convert(msg, ros_msg_);
+            auto converted = SensorStats::Clock::now();
+            callback_(ros_msg_);
+            stats_->recordPublished(start, converted, SensorStats::Clock::now());
+        };
+
+        SensorStats &stats() { return *stats_; };
+
+    private:
+        typename Stream::RosMsg ros_msg_;
+        Callback callback_;
+        std::shared_ptr<SensorStats> stats_;
+    };
+
+    template <typename IgnMsgT, typename Callback>
+    std::shared_ptr<SensorChannel<IgnMsgT, Callback>> makeSensorChannel(Callback callback,
+                                                                        std::shared_ptr<SensorStats> stats)
+    {
+        return std::make_shared<SensorChannel<IgnMsgT, Callback>>(std::move(callback), std::move(stats));
+    };
+}
+
+#endif // SENSOR_CHANNEL_HPP_
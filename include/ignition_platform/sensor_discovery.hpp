@@ -0,0 +1,106 @@
+/*!*******************************************************************************************
+ *  \file       sensor_discovery.hpp
+ *  \brief      Discovery of the sensors of a model from the ignition topic list
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef SENSOR_DISCOVERY_HPP_
+#define SENSOR_DISCOVERY_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ignition/transport.hh>
+
+namespace ignition_platform
+{
+    // Sensor attached to a model, as found in its ignition topics:
+    // /world/<world_name>/model/<model_name>/model/<sensor_name>/link/<link_name>/sensor/<sensor_type>/...
+    struct SensorConfig
+    {
+        std::string world_name;
+        std::string model_name;
+        std::string sensor_name;
+        std::string link_name;
+        std::string sensor_type;
+    };
+
+    // Periodically scans the ignition topic list on a background thread and collects the sensors
+    // of one model, so neither startup nor the ROS executor waits for the simulator. Sensors that
+    // appear later are picked up on the next scan.
+    class SensorDiscovery
+    {
+    public:
+        SensorDiscovery(std::shared_ptr<ignition::transport::Node> ign_node,
+                        const std::string &model_name,
+                        std::chrono::milliseconds period);
+        ~SensorDiscovery();
+
+        // Sensors found since the previous call
+        std::vector<SensorConfig> takeNewSensors();
+
+        // Name of the world the model lives in, empty until one of its topics is seen
+        std::string getWorldName();
+
+        static bool parseSensorTopic(const std::string &topic,
+                                     const std::string &model_name,
+                                     SensorConfig &config);
+        static bool parseWorldName(const std::string &topic,
+                                   const std::string &model_name,
+                                   std::string &world_name);
+
+    private:
+        void run();
+        void scan();
+
+        std::shared_ptr<ignition::transport::Node> ign_node_ptr_;
+        std::string model_name_;
+        std::chrono::milliseconds period_;
+
+        std::mutex mutex_;
+        std::condition_variable stop_condition_;
+        bool stop_ = false;
+        std::string world_name_;
+        std::set<std::string> known_sensors_;
+        std::vector<SensorConfig> new_sensors_;
+        std::thread thread_;
+    };
+}
+
+#endif // SENSOR_DISCOVERY_HPP_
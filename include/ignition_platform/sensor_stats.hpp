@@ -0,0 +1,81 @@
+/*!*******************************************************************************************
+ *  \file       sensor_stats.hpp
+ *  \brief      Per-sensor throughput and latency counters of the bridge
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef SENSOR_STATS_HPP_
+#define SENSOR_STATS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "latency_histogram.hpp"
+
+namespace ignition_platform
+{
+    // Counters of one sensor stream. They are written by the ignition transport thread that
+    // delivers the stream and read periodically by the ROS thread reporting them, so every field
+    // is a relaxed atomic and recording never locks or allocates.
+    struct SensorStats
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> published{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> bytes{0};
+
+        // Time spent converting the ignition message and dispatching it to its ROS publisher
+        LatencyHistogram conversion_time;
+        LatencyHistogram dispatch_time;
+
+        void recordReceived(uint64_t message_bytes)
+        {
+            received.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(message_bytes, std::memory_order_relaxed);
+        };
+
+        void recordPublished(Clock::time_point start, Clock::time_point converted, Clock::time_point dispatched)
+        {
+            published.fetch_add(1, std::memory_order_relaxed);
+            conversion_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(converted - start).count());
+            dispatch_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(dispatched - converted).count());
+        };
+
+        void recordDropped() { dropped.fetch_add(1, std::memory_order_relaxed); };
+    };
+}
+
+#endif // SENSOR_STATS_HPP_
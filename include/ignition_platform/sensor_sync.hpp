@@ -0,0 +1,381 @@
+/*!*******************************************************************************************
+ *  \file       sensor_sync.hpp
+ *  \brief      Exact simulation stamp bundles of several sensor streams
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef SENSOR_SYNC_HPP_
+#define SENSOR_SYNC_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ignition_platform
+{
+    // Messages of one bundle member, ordered by simulation stamp
+    class SyncMember
+    {
+    public:
+        virtual ~SyncMember() = default;
+
+        virtual size_t size() const = 0;
+        // Stamp of the i-th oldest message
+        virtual int64_t stamp(size_t i) const = 0;
+        // Newest stamp held, -1 when empty
+        virtual int64_t newest() const = 0;
+        virtual bool has(int64_t stamp_ns) const = 0;
+        // Sets aside for publishing the message stamped to_ns, or for a window every message in
+        // (from_ns, to_ns], forgets everything up to to_ns and returns how many were set aside
+        virtual size_t release(int64_t from_ns, int64_t to_ns) = 0;
+        virtual void clear() = 0;
+        // Hands the messages set aside so far over to be published without the lock
+        virtual void startPublishing() = 0;
+        // Publishes the next message handed over
+        virtual void publishNext() = 0;
+        // Keeps the storage of the published messages for the next ones released
+        virtual void finishPublishing() = 0;
+    };
+
+    // Ring of the last messages of a sensor. The slots keep their storage, so once they have
+    // been filled a new message is copied without allocating. A released message is swapped
+    // out of its slot for the storage of one already published, so releasing does not copy or
+    // allocate either.
+    template <typename MessageT>
+    class StampRing : public SyncMember
+    {
+    public:
+        using Publish = std::function<void(const MessageT &)>;
+
+        StampRing(size_t capacity, bool window, Publish publish)
+            : window_(window), publish_(std::move(publish)), slots_(std::max<size_t>(capacity, 1)),
+              stamps_(slots_.size()){};
+
+        void insert(const MessageT &msg)
+        {
+            const int64_t stamp_ns = static_cast<int64_t>(msg.header.stamp.sec) * 1000000000 +
+                                     msg.header.stamp.nanosec;
+            // Time going back means the simulation was reset, and older messages never match again
+            if (stamp_ns < newest())
+            {
+                clear();
+            }
+            if (count_ == slots_.size())
+            {
+                pop();
+            }
+            const size_t index = (head_ + count_) % slots_.size();
+            slots_[index] = msg;
+            stamps_[index] = stamp_ns;
+            count_++;
+        };
+
+        size_t size() const override { return count_; };
+
+        int64_t stamp(size_t i) const override { return stamps_[(head_ + i) % slots_.size()]; };
+
+        int64_t newest() const override { return count_ > 0 ? stamp(count_ - 1) : -1; };
+
+        bool has(int64_t stamp_ns) const override
+        {
+            for (size_t i = 0; i < count_; i++)
+            {
+                if (stamp(i) == stamp_ns)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        size_t release(int64_t from_ns, int64_t to_ns) override
+        {
+            size_t released = 0;
+            while (count_ > 0 && stamp(0) <= to_ns)
+            {
+                if (window_ ? stamp(0) > from_ns : stamp(0) == to_ns)
+                {
+                    if (spares_.empty())
+                    {
+                        spares_.emplace_back();
+                    }
+                    std::swap(slots_[head_], spares_.back());
+                    released_.push_back(std::move(spares_.back()));
+                    spares_.pop_back();
+                    released++;
+                }
+                pop();
+            }
+            return released;
+        };
+
+        void clear() override { count_ = 0; };
+
+        void startPublishing() override
+        {
+            std::swap(released_, publishing_);
+            next_ = 0;
+        };
+
+        void publishNext() override { publish_(publishing_[next_++]); };
+
+        void finishPublishing() override
+        {
+            for (auto &msg : publishing_)
+            {
+                spares_.push_back(std::move(msg));
+            }
+            publishing_.clear();
+        };
+
+    private:
+        void pop()
+        {
+            head_ = (head_ + 1) % slots_.size();
+            count_--;
+        };
+
+        bool window_;
+        Publish publish_;
+        std::vector<MessageT> slots_;
+        std::vector<int64_t> stamps_;
+        size_t head_ = 0;
+        size_t count_ = 0;
+        // Released and waiting, being published, and published messages kept for their storage
+        std::vector<MessageT> released_;
+        std::vector<MessageT> publishing_;
+        std::vector<MessageT> spares_;
+        size_t next_ = 0;
+    };
+
+    // Messages of several sensors published together once all of them reached the same simulation
+    // stamp. Exact members need a message with that very stamp, like the two cameras of a stereo
+    // pair or a lidar and the pose. Window members release every message since the previous
+    // bundle, like the IMU samples between two camera frames, once one of them gets past the
+    // stamp. A stamp some exact member never delivers is skipped when a later one completes.
+    //
+    // Members are fed from the threads converting their sensors. Completed bundles are set aside
+    // under the lock and published after it by one feed at a time, the first to find them
+    // waiting, so the messages of a bundle go out back to back, bundles go out in stamp order and
+    // a window always goes out before the frame closing it. A slow subscriber never holds up the
+    // other feeds, but a feed may return before its own bundle went out. Nothing is released
+    // until every member was added.
+    class SensorBundle : public std::enable_shared_from_this<SensorBundle>
+    {
+    public:
+        SensorBundle(std::string name, const std::vector<std::string> &exact,
+                     const std::vector<std::string> &window, size_t buffer_size, size_t window_size)
+            : name_(std::move(name)), exact_count_(exact.size()), buffer_size_(buffer_size),
+              window_size_(window_size)
+        {
+            names_ = exact;
+            names_.insert(names_.end(), window.begin(), window.end());
+            members_.resize(names_.size());
+        };
+
+        const std::string &name() const { return name_; };
+
+        size_t windowSize() const { return window_size_; };
+
+        bool contains(const std::string &sensor_name) const
+        {
+            return std::find(names_.begin(), names_.end(), sensor_name) != names_.end();
+        };
+
+        bool isWindow(const std::string &sensor_name) const
+        {
+            return std::find(names_.begin(), names_.end(), sensor_name) - names_.begin() >=
+                   static_cast<std::ptrdiff_t>(exact_count_);
+        };
+
+        // Returns the function feeding the messages of the sensor into the bundle, empty if the
+        // sensor is not a member
+        template <typename MessageT>
+        std::function<void(const MessageT &)> addMember(const std::string &sensor_name,
+                                                        std::function<void(const MessageT &)> publish)
+        {
+            auto name = std::find(names_.begin(), names_.end(), sensor_name);
+            if (name == names_.end())
+            {
+                return nullptr;
+            }
+            const size_t index = name - names_.begin();
+            const bool window = index >= exact_count_;
+            auto ring = std::make_shared<StampRing<MessageT>>(window ? window_size_ : buffer_size_,
+                                                              window, std::move(publish));
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                members_[index] = ring;
+            }
+            auto self = shared_from_this();
+            return [self, ring](const MessageT &msg)
+            {
+                std::unique_lock<std::mutex> lock(self->mutex_);
+                ring->insert(msg);
+                // After a simulation reset, whatever the other members hold is from before it
+                if (ring->newest() < self->last_ns_)
+                {
+                    for (const auto &member : self->members_)
+                    {
+                        if (member && member != ring)
+                        {
+                            member->clear();
+                        }
+                    }
+                    self->last_ns_ = -1;
+                }
+                self->release();
+                self->publishReleased(lock);
+            };
+        };
+
+    private:
+        bool ready(int64_t stamp_ns) const
+        {
+            for (size_t i = 0; i < members_.size(); i++)
+            {
+                if (i < exact_count_ ? !members_[i]->has(stamp_ns) : members_[i]->newest() < stamp_ns)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        void release()
+        {
+            if (exact_count_ == 0)
+            {
+                return;
+            }
+            for (const auto &member : members_)
+            {
+                if (!member)
+                {
+                    return;
+                }
+            }
+
+            // Candidates are the stamps of the first exact member, oldest first. Releasing drops
+            // them up to the one released, so the scan starts over until none is complete.
+            const SyncMember &reference = *members_[0];
+            size_t i = 0;
+            while (i < reference.size())
+            {
+                const int64_t stamp_ns = reference.stamp(i);
+                if (stamp_ns <= last_ns_ || !ready(stamp_ns))
+                {
+                    i++;
+                    continue;
+                }
+                // Windows first, so a consumer has every sample up to the frame when it gets it
+                for (size_t m = members_.size(); m-- > 0;)
+                {
+                    const size_t released = members_[m]->release(last_ns_, stamp_ns);
+                    order_.insert(order_.end(), released, members_[m].get());
+                }
+                last_ns_ = stamp_ns;
+                i = 0;
+            }
+        };
+
+        // Publishes the messages set aside with the lock released, unless another feed already is
+        void publishReleased(std::unique_lock<std::mutex> &lock)
+        {
+            if (publishing_)
+            {
+                return;
+            }
+            publishing_ = true;
+            while (!order_.empty())
+            {
+                std::swap(order_, publishing_order_);
+                for (const auto &member : members_)
+                {
+                    member->startPublishing();
+                }
+                lock.unlock();
+                try
+                {
+                    for (SyncMember *member : publishing_order_)
+                    {
+                        member->publishNext();
+                    }
+                }
+                catch (...)
+                {
+                    lock.lock();
+                    finishPublishing();
+                    publishing_ = false;
+                    throw;
+                }
+                lock.lock();
+                finishPublishing();
+            }
+            publishing_ = false;
+            return;
+        };
+
+        void finishPublishing()
+        {
+            for (const auto &member : members_)
+            {
+                member->finishPublishing();
+            }
+            publishing_order_.clear();
+            return;
+        };
+
+        std::string name_;
+        std::vector<std::string> names_;
+        size_t exact_count_;
+        size_t buffer_size_;
+        size_t window_size_;
+        std::mutex mutex_;
+        // Exact members first, then window members
+        std::vector<std::shared_ptr<SyncMember>> members_;
+        int64_t last_ns_ = -1;
+        // Member of each message set aside, in publishing order, and of those being published
+        std::vector<SyncMember *> order_;
+        std::vector<SyncMember *> publishing_order_;
+        bool publishing_ = false;
+    };
+}
+
+#endif // SENSOR_SYNC_HPP_
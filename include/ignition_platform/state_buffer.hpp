@@ -0,0 +1,114 @@
+/*!*******************************************************************************************
+ *  \file       state_buffer.hpp
+ *  \brief      Lock-free single writer buffer for the latest vehicle state
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef STATE_BUFFER_HPP_
+#define STATE_BUFFER_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ignition_platform
+{
+    // Sequence lock holding the latest value of a trivially copyable type. A single ignition
+    // transport thread stores and never blocks; readers retry while a store is in progress, so
+    // they never see a torn value. The payload lives in atomic words, and the ordering comes from
+    // release stores and acquire loads of those words rather than from fences, which
+    // ThreadSanitizer does not model. On x86 both are plain moves.
+    template <typename T>
+    class StateBuffer
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "StateBuffer needs a trivially copyable type");
+
+    public:
+        StateBuffer()
+        {
+            for (auto &word : data_)
+            {
+                word.store(0, std::memory_order_relaxed);
+            }
+        };
+
+        // Must only be called from a single writer thread
+        void store(const T &value)
+        {
+            std::array<uint64_t, kWords> words{};
+            std::memcpy(words.data(), &value, sizeof(T));
+
+            const uint64_t seq = seq_.load(std::memory_order_relaxed);
+            seq_.store(seq + 1, std::memory_order_relaxed);
+            // A reader seeing any of the new words also sees the odd sequence
+            for (size_t i = 0; i < kWords; i++)
+            {
+                data_[i].store(words[i], std::memory_order_release);
+            }
+            seq_.store(seq + 2, std::memory_order_release);
+        };
+
+        // Returns the sequence of the value read (0 if nothing has been stored yet). Each store
+        // increases it, so callers can tell whether a new value arrived since their last load.
+        uint64_t load(T &value) const
+        {
+            std::array<uint64_t, kWords> words;
+            uint64_t seq_begin, seq_end;
+            do
+            {
+                seq_begin = seq_.load(std::memory_order_acquire);
+                // Acquire loads keep the second read of the sequence after the words
+                for (size_t i = 0; i < kWords; i++)
+                {
+                    words[i] = data_[i].load(std::memory_order_acquire);
+                }
+                seq_end = seq_.load(std::memory_order_relaxed);
+            } while (seq_begin != seq_end || (seq_begin & 1));
+
+            std::memcpy(&value, words.data(), sizeof(T));
+            return seq_begin / 2;
+        };
+
+        uint64_t sequence() const { return seq_.load(std::memory_order_acquire) / 2; };
+
+    private:
+        static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        std::atomic<uint64_t> seq_{0};
+        std::array<std::atomic<uint64_t>, kWords> data_;
+    };
+}
+
+#endif // STATE_BUFFER_HPP_
@@ -0,0 +1,281 @@
+/*!*******************************************************************************************
+ *  \file       stream_policy.hpp
+ *  \brief      Rate limiting and latest-value conflation of high rate sensor streams
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef STREAM_POLICY_HPP_
+#define STREAM_POLICY_HPP_
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ignition_platform
+{
+    // How the frames of a high rate stream are thinned before they are converted
+    struct StreamPolicy
+    {
+        // Maximum publish rate in Hz, 0 for no limit
+        double max_rate = 0.0;
+        // Convert only the newest frame, dropping older ones instead of queuing them
+        bool latest_only = false;
+        // Frames waiting for conversion when not latest_only, the oldest is dropped when full
+        size_t queue_size = 4;
+    };
+
+    // Decimates a stream to a maximum rate using the frame stamps, so the result follows the
+    // simulation clock. Frames within a twentieth of the period are accepted to absorb jitter.
+    class RateLimiter
+    {
+    public:
+        explicit RateLimiter(double max_rate)
+            : period_ns_(max_rate > 0.0 ? static_cast<int64_t>(1e9 / max_rate) : 0){};
+
+        bool accept(int64_t stamp_ns)
+        {
+            if (period_ns_ == 0)
+            {
+                return true;
+            }
+            // Without a stamp the arrival time is used instead
+            if (stamp_ns == 0)
+            {
+                stamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now().time_since_epoch())
+                               .count();
+            }
+            // A stamp going backwards means the simulation was reset
+            if (last_stamp_ns_ >= 0 && stamp_ns >= last_stamp_ns_ &&
+                stamp_ns - last_stamp_ns_ < period_ns_ - period_ns_ / 20)
+            {
+                return false;
+            }
+            last_stamp_ns_ = stamp_ns;
+            return true;
+        };
+
+    private:
+        int64_t period_ns_;
+        int64_t last_stamp_ns_ = -1;
+    };
+
+    // Fixed set of threads running the handlers of many streams, so a slow frame of one sensor
+    // holds neither the ignition transport thread nor the other sensors. Tasks that are ready wait
+    // in a single queue and each run handles one message before going to the back, so a busy
+    // stream cannot starve the others. A pool without threads leaves the handlers inline.
+    //
+    // The workers run at a lower priority than the rest of the process. Odometry, IMU and the
+    // commands are handled on the ignition transport and executor threads, and where there are
+    // not enough cores for everything the scheduler gives those threads the CPU first instead of
+    // sharing it evenly with a backlog of frames.
+    class WorkerPool
+    {
+    public:
+        // Added to the nice value of each worker thread
+        static constexpr int kWorkerNiceness = 10;
+
+        class Task
+        {
+        public:
+            virtual ~Task() = default;
+            // Handles one message, returns true if more are waiting
+            virtual bool runOnce() = 0;
+        };
+
+        explicit WorkerPool(size_t threads)
+        {
+            for (size_t i = 0; i < threads; i++)
+            {
+                threads_.emplace_back(&WorkerPool::run, this);
+            }
+        };
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            condition_.notify_all();
+            for (auto &thread : threads_)
+            {
+                thread.join();
+            }
+        };
+
+        bool inlineOnly() const { return threads_.empty(); };
+
+        void post(std::shared_ptr<Task> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ready_.emplace_back(std::move(task));
+            }
+            condition_.notify_one();
+        };
+
+    private:
+        void run()
+        {
+            // On Linux the nice value belongs to the thread. Lowering it needs no privilege, and
+            // the workers still run at the normal priority should it fail.
+            const id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+            errno = 0;
+            const int niceness = getpriority(PRIO_PROCESS, tid);
+            if (errno == 0)
+            {
+                setpriority(PRIO_PROCESS, tid, std::min(niceness + kWorkerNiceness, 19));
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                condition_.wait(lock, [this]()
+                                { return !ready_.empty() || stop_; });
+                if (stop_)
+                {
+                    return;
+                }
+                std::shared_ptr<Task> task = std::move(ready_.front());
+                ready_.pop_front();
+
+                lock.unlock();
+                const bool more = task->runOnce();
+                lock.lock();
+                if (more)
+                {
+                    ready_.emplace_back(std::move(task));
+                }
+            }
+        };
+
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        std::deque<std::shared_ptr<Task>> ready_;
+        bool stop_ = false;
+        std::vector<std::thread> threads_;
+    };
+
+    // Messages of one stream handled on a WorkerPool strictly in arrival order, one at a time.
+    // At most capacity messages wait, and the oldest one is dropped to make room for a new one,
+    // so a capacity of 1 only ever converts the newest message. The waiting slots keep their
+    // storage, so steady state does not allocate.
+    template <typename MessageT>
+    class Strand : public WorkerPool::Task, public std::enable_shared_from_this<Strand<MessageT>>
+    {
+    public:
+        using Handler = std::function<void(const MessageT &)>;
+
+        Strand(WorkerPool &pool, size_t capacity, Handler handler)
+            : pool_(pool), handler_(std::move(handler)), slots_(std::max<size_t>(capacity, 1)){};
+
+        // Returns false if a waiting message was dropped
+        bool push(const MessageT &msg)
+        {
+            // Each stream is delivered by a single thread, so inline handling keeps the order
+            if (pool_.inlineOnly())
+            {
+                handler_(msg);
+                return true;
+            }
+
+            bool dropped = false;
+            bool schedule = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (count_ == slots_.size())
+                {
+                    head_ = (head_ + 1) % slots_.size();
+                    count_--;
+                    dropped = true;
+                }
+                slots_[(head_ + count_) % slots_.size()].CopyFrom(msg);
+                count_++;
+                schedule = !scheduled_;
+                scheduled_ = true;
+            }
+            if (schedule)
+            {
+                pool_.post(this->shared_from_this());
+            }
+            return !dropped;
+        };
+
+        bool runOnce() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (count_ == 0)
+                {
+                    scheduled_ = false;
+                    return false;
+                }
+                slots_[head_].Swap(&current_);
+                head_ = (head_ + 1) % slots_.size();
+                count_--;
+            }
+            // Only one worker runs a strand at a time, so current_ needs no lock
+            handler_(current_);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            scheduled_ = count_ > 0;
+            return scheduled_;
+        };
+
+    private:
+        WorkerPool &pool_;
+        Handler handler_;
+        std::mutex mutex_;
+        std::vector<MessageT> slots_;
+        size_t head_ = 0;
+        size_t count_ = 0;
+        bool scheduled_ = false;
+        MessageT current_;
+    };
+}
+
+#endif // STREAM_POLICY_HPP_
@@ -0,0 +1,164 @@
+/*!*******************************************************************************************
+ *  \file       stream_recorder.hpp
+ *  \brief      Recording and replay of raw ignition sensor streams
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef STREAM_RECORDER_HPP_
+#define STREAM_RECORDER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ignition/transport.hh>
+
+namespace ignition_platform
+{
+    // Recordings are a sequence of segment files "<path>.<index>". Each one starts with a magic
+    // and holds 8 byte aligned records: the definition of a topic (its name and message type,
+    // each null terminated) or a serialized message of a topic already defined. Every segment
+    // starts with the definitions of all the topics known so far. A record whose kind is still
+    // zero was never committed and ends the segment.
+    struct RecordHeader
+    {
+        enum Kind : uint16_t
+        {
+            TOPIC = 1,
+            MESSAGE = 2
+        };
+
+        uint32_t size;
+        uint16_t kind;
+        uint16_t topic_id;
+        // Steady clock when the message was received
+        int64_t receive_ns;
+    };
+
+    // Appends every ignition message it is given to memory mapped segment files. Messages are
+    // serialized straight into the mapping, so recording costs a copy and no system call except
+    // when a segment fills up and the next one is created. Safe to call from any thread.
+    class StreamRecorder
+    {
+    public:
+        StreamRecorder(const std::string &path, size_t segment_size);
+        ~StreamRecorder();
+
+        // Id under which the messages of a topic are recorded
+        uint16_t addTopic(const std::string &topic, const std::string &message_type);
+
+        template <typename MessageT>
+        void record(uint16_t topic_id, const MessageT &msg)
+        {
+            const int64_t receive_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                           std::chrono::steady_clock::now().time_since_epoch())
+                                           .count();
+            const size_t size = msg.ByteSizeLong();
+            std::shared_ptr<Segment> segment;
+            RecordHeader *header = reserve(size, segment);
+            if (!header)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            msg.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(header + 1));
+            commit(header, RecordHeader::MESSAGE, topic_id, receive_ns, size);
+        };
+
+        // Messages that did not fit in a segment, or arrived after a segment could not be created
+        std::atomic<uint64_t> dropped{0};
+
+    private:
+        struct Segment;
+
+        RecordHeader *reserve(size_t size, std::shared_ptr<Segment> &segment);
+        RecordHeader *reserveLocked(size_t size);
+        static void commit(RecordHeader *header, uint16_t kind, uint16_t topic_id,
+                           int64_t receive_ns, size_t size);
+        bool openSegment();
+
+        std::string path_;
+        size_t segment_size_;
+        size_t segment_index_ = 0;
+
+        std::mutex mutex_;
+        std::shared_ptr<Segment> segment_;
+        std::vector<std::pair<std::string, std::string>> topics_;
+    };
+
+    // Publishes a recording back on ignition transport, so a platform in the same process receives
+    // it through its usual subscriptions as if the simulator were running. Topics are advertised
+    // upfront for sensor discovery, and playback starts after a delay that lets the platform
+    // subscribe. A speed of 0 plays as fast as possible.
+    class StreamReplay
+    {
+    public:
+        StreamReplay(std::shared_ptr<ignition::transport::Node> ign_node, const std::string &path,
+                     double speed, std::chrono::milliseconds start_delay);
+        ~StreamReplay();
+
+        size_t messages() const { return messages_.load(std::memory_order_relaxed); };
+        bool finished() const { return finished_.load(std::memory_order_acquire); };
+
+    private:
+        struct Mapping
+        {
+            const char *data;
+            size_t size;
+        };
+
+        void run();
+
+        std::shared_ptr<ignition::transport::Node> ign_node_ptr_;
+        double speed_;
+        std::chrono::milliseconds start_delay_;
+        std::vector<Mapping> segments_;
+        std::vector<std::string> message_types_;
+        std::vector<ignition::transport::Node::Publisher> publishers_;
+        std::atomic<size_t> messages_{0};
+
+        std::mutex mutex_;
+        std::condition_variable stop_condition_;
+        bool stop_ = false;
+        std::atomic<bool> finished_{false};
+        std::thread thread_;
+    };
+}
+
+#endif // STREAM_RECORDER_HPP_
@@ -1,26 +1,70 @@
 from launch import LaunchDescription
-from launch_ros.actions import Node
+from launch_ros.actions import Node, LoadComposableNodes
+from launch_ros.descriptions import ComposableNode
 from launch.actions import DeclareLaunchArgument, OpaqueFunction
 from launch.substitutions import LaunchConfiguration, PathJoinSubstitution, EnvironmentVariable
 from launch_ros.substitutions import FindPackageShare
 
-import subprocess
 
+def get_platform_node(context, *args, **kwargs):
+    drone_ids = [drone_id for drone_id in LaunchConfiguration('drone_ids').perform(context).split(',')
+                 if drone_id]
 
-def get_sensors(drone_namespace):
-    sensors  = set()
+    parameters = {
+        "control_modes_file": LaunchConfiguration('control_modes_file'),
+        "simulation_mode": True,
+        "mass": LaunchConfiguration('mass'),
+        "max_thrust": LaunchConfiguration('max_thrust'),
+        "min_thrust":  LaunchConfiguration('min_thrust'),
+        "cmd_freq": LaunchConfiguration('cmd_freq'),
+        "platform_freq": LaunchConfiguration('platform_freq'),
+        "use_sim_time": LaunchConfiguration('use_sim_time'),
+        "publish_clock": LaunchConfiguration('publish_clock'),
+        "stats_period": LaunchConfiguration('stats_period'),
+        "event_driven_commands": LaunchConfiguration('event_driven_commands'),
+        "sensor_discovery_period": LaunchConfiguration('sensor_discovery_period'),
+        "lazy_subscriptions": LaunchConfiguration('lazy_subscriptions'),
+        "camera_max_rate": LaunchConfiguration('camera_max_rate'),
+        "camera_latest_only": LaunchConfiguration('camera_latest_only'),
+        "lidar_points_from_scan": LaunchConfiguration('lidar_points_from_scan'),
+        "static_tf_timeout": LaunchConfiguration('static_tf_timeout'),
+        "record_path": LaunchConfiguration('record_path'),
+        "replay_path": LaunchConfiguration('replay_path'),
+        "replay_speed": LaunchConfiguration('replay_speed'),
+        "executor_threads": LaunchConfiguration('executor_threads'),
+        "conversion_threads": LaunchConfiguration('conversion_threads'),
+    }
 
-    cmd = f"ign topic -l"
-    output = subprocess.run(cmd.split(), capture_output=True, text=True)
-    for line in output.stdout.split('\n'):
-        if f"{drone_namespace}/model" in line:
-            tokens = line.split('/')
-            sensors.add(f"{tokens[2]},{tokens[4]},{tokens[6]},{tokens[8]},{tokens[10]}")
-    return repr(sensors).replace("', '", ":")[2:-2] if len(sensors) else ""
+    # Several drones hosted by a single process
+    if drone_ids:
+        parameters["drone_ids"] = drone_ids
 
+        node = Node(
+            package="ignition_platform",
+            executable="ignition_platform_node",
+            output="screen",
+            emulate_tty=True,
+            parameters=[parameters]
+        )
+        return [node]
 
-def get_platform_node(context, *args, **kwargs):
-    drone_namespace = LaunchConfiguration('drone_id').perform(context)
+    # Loaded next to its consumers, which then get sensor messages intra-process
+    container = LaunchConfiguration('container').perform(context)
+    if container:
+        load = LoadComposableNodes(
+            target_container=container,
+            composable_node_descriptions=[
+                ComposableNode(
+                    package="ignition_platform",
+                    plugin="ignition_platform::IgnitionPlatform",
+                    name="platform",
+                    namespace=LaunchConfiguration('drone_id'),
+                    parameters=[parameters],
+                    extra_arguments=[{'use_intra_process_comms': True}]
+                )
+            ]
+        )
+        return [load]
 
     node = Node(
         package="ignition_platform",
@@ -28,14 +72,7 @@ def get_platform_node(context, *args, **kwargs):
         namespace=LaunchConfiguration('drone_id'),
         output="screen",
         emulate_tty=True,
-        parameters=[
-            {"control_modes_file": LaunchConfiguration('control_modes_file'),
-            "simulation_mode": True,
-            "mass": LaunchConfiguration('mass'),
-            "max_thrust": LaunchConfiguration('max_thrust'),
-            "min_thrust":  LaunchConfiguration('min_thrust'),
-            "sensors": get_sensors(drone_namespace)
-            }]
+        parameters=[parameters]
     )
     return [node]
 
@@ -47,10 +84,48 @@ def generate_launch_description():
     ])
     return LaunchDescription([
         DeclareLaunchArgument('drone_id', default_value=EnvironmentVariable('AEROSTACK2_SIMULATION_DRONE_ID')),
+        DeclareLaunchArgument('container', default_value='',
+                              description='Component container to load the platform into'),
+        DeclareLaunchArgument('drone_ids', default_value='',
+                              description='Comma separated drone ids hosted by a single process'),
         DeclareLaunchArgument('mass', default_value='1.5'),
         DeclareLaunchArgument('max_thrust', default_value='15.0'),
         DeclareLaunchArgument('min_thrust', default_value='0.15'),
         DeclareLaunchArgument('control_modes_file', default_value=config),
+        DeclareLaunchArgument('cmd_freq', default_value='100.0',
+                              description='Command forwarding (keep-alive) rate in Hz'),
+        DeclareLaunchArgument('platform_freq', default_value='60.0',
+                              description='Rate in Hz of the platform loop: sensor discovery, sensor demand and static transform checks'),
+        DeclareLaunchArgument('use_sim_time', default_value='false',
+                              description='Drive the command and platform loops with the simulation clock'),
+        DeclareLaunchArgument('publish_clock', default_value='false',
+                              description='Republish the ignition clock on /clock'),
+        DeclareLaunchArgument('stats_period', default_value='1.0',
+                              description='Period in seconds of the sensor stats on /diagnostics, 0 to disable'),
+        DeclareLaunchArgument('event_driven_commands', default_value='false',
+                              description='Forward each command to ignition as soon as it arrives'),
+        DeclareLaunchArgument('sensor_discovery_period', default_value='1.0',
+                              description='Period in seconds of the ignition sensor discovery, 0 to disable'),
+        DeclareLaunchArgument('lazy_subscriptions', default_value='true',
+                              description='Bridge camera and lidar streams only while they have ROS subscribers'),
+        DeclareLaunchArgument('camera_max_rate', default_value='0.0',
+                              description='Default maximum camera publish rate in Hz, 0 for no limit'),
+        DeclareLaunchArgument('camera_latest_only', default_value='true',
+                              description='Convert only the newest camera frame instead of queuing them'),
+        DeclareLaunchArgument('lidar_points_from_scan', default_value='false',
+                              description='Project lidar points from the scan instead of subscribing to them'),
+        DeclareLaunchArgument('static_tf_timeout', default_value='10.0',
+                              description='Seconds to wait for the static transform of a new sensor'),
+        DeclareLaunchArgument('record_path', default_value='',
+                              description='Record the raw ignition messages to <record_path>.<n> segments'),
+        DeclareLaunchArgument('replay_path', default_value='',
+                              description='Replay a recording instead of listening to the simulator'),
+        DeclareLaunchArgument('replay_speed', default_value='1.0',
+                              description='Replay speed factor, 0 for as fast as possible'),
+        DeclareLaunchArgument('executor_threads', default_value='2',
+                              description='Threads of the executor, the container decides when loaded into one'),
+        DeclareLaunchArgument('conversion_threads', default_value='0',
+                              description='Threads converting camera and lidar messages, at most one less than the cores. 0 converts them inline'),
         
         OpaqueFunction(function=get_platform_node)
     ])
@@ -36,7 +36,15 @@
 
 #include "ignition_bridge.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 namespace ignition_platform {
+static int64_t stampNs(const ignition::msgs::Header &header) {
+  return static_cast<int64_t>(header.stamp().sec()) * 1000000000 + header.stamp().nsec();
+};
+
 static std::string refactorizeFrameId(const std::string &original_frame_id,
                                       const std::string &sensor_name,
                                       const std::string &field_to_append = "") {
@@ -64,57 +72,67 @@ static std::string refactorizeFrameId(const std::string &original_frame_id,
   return frame_id;
 };
 
-std::string IgnitionBridge::name_space_ = "";
-poseCallbackType IgnitionBridge::poseCallback_ = [](geometry_msgs::msg::PoseStamped &msg) {};
-odometryCallbackType IgnitionBridge::odometryCallback_ = [](nav_msgs::msg::Odometry &msg) {};
-
-imuSensorCallbackType IgnitionBridge::imuCallback_ = [](sensor_msgs::msg::Imu &msg) {};
-airPressureSensorCallbackType IgnitionBridge::airPressureCallback_ =
-    [](sensor_msgs::msg::FluidPressure &msg) {};
-magnetometerSensorCallbackType IgnitionBridge::magnetometerCallback_ =
-    [](sensor_msgs::msg::MagneticField &msg) {};
-
-std::unordered_map<std::string, std::string> IgnitionBridge::callbacks_sensors_names_ = {};
-std::unordered_map<std::string, tfCallbackType> IgnitionBridge::callbacks_sensors_transform_ = {};
-
-std::unordered_map<std::string, cameraCallbackType> IgnitionBridge::callbacks_camera_ = {};
-std::unordered_map<std::string, cameraInfoCallbackType> IgnitionBridge::callbacks_camera_info_ = {};
-std::unordered_map<std::string, laserScanCallbackType> IgnitionBridge::callbacks_laser_scan_ = {};
-std::unordered_map<std::string, pointCloudCallbackType> IgnitionBridge::callbacks_point_cloud_ = {};
-std::unordered_map<std::string, gpsCallbackType> IgnitionBridge::callbacks_gps_ = {};
-std::unordered_map<std::string, imuCallbackType> IgnitionBridge::callbacks_imu_ = {};
-std::unordered_map<std::string, airPressureCallbackType> IgnitionBridge::callbacks_air_pressure_ =
-    {};
-std::unordered_map<std::string, magnetometerCallbackType> IgnitionBridge::callbacks_magnetometer_ =
-    {};
-
-IgnitionBridge::IgnitionBridge(std::string name_space) {
-  name_space_ = name_space;
+template <typename RepeatedT>
+static bool sameValues(const RepeatedT &a, const RepeatedT &b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end());
+};
 
-  // Initialize the ignition node
-  ign_node_ptr_ = std::make_shared<ignition::transport::Node>();
+static bool sameCalibration(const ignition::msgs::CameraInfo &a, const ignition::msgs::CameraInfo &b) {
+  return a.width() == b.width() && a.height() == b.height() &&
+         a.distortion().model() == b.distortion().model() &&
+         sameValues(a.distortion().k(), b.distortion().k()) &&
+         sameValues(a.intrinsics().k(), b.intrinsics().k()) &&
+         sameValues(a.projection().p(), b.projection().p()) &&
+         sameValues(a.rectification_matrix(), b.rectification_matrix());
+};
 
+IgnitionBridge::IgnitionBridge(std::string name_space, std::shared_ptr<StreamRecorder> recorder,
+                               const ignition::transport::NodeOptions &node_options)
+    : ign_node_ptr_(std::make_shared<ignition::transport::Node>(node_options)),
+      name_space_(name_space),
+      recorder_(recorder) {
   // Initialize publishers
   command_twist_pub_ = ign_node_ptr_->Advertise<ignition::msgs::Twist>("model" + name_space +
                                                                        ign_topic_command_twist_);
 
+  pose_stats_ = addSensorStats("pose");
+  odometry_stats_ = addSensorStats("odom");
+
   // Initialize subscribers
-  ign_node_ptr_->Subscribe("model" + name_space + ign_topic_sensor_pose_,
-                           IgnitionBridge::ignitionPoseCallback);
+  subscribe<ignition::msgs::Pose>(
+      "model" + name_space + ign_topic_sensor_pose_,
+      [this](const ignition::msgs::Pose &msg) { ignitionPoseCallback(msg); });
 
-  ign_node_ptr_->Subscribe("model" + name_space + ign_topic_sensor_odometry_,
-                           IgnitionBridge::ignitionOdometryCallback);
+  subscribe<ignition::msgs::Odometry>(
+      "model" + name_space + ign_topic_sensor_odometry_,
+      [this](const ignition::msgs::Odometry &msg) { ignitionOdometryCallback(msg); });
 
-  ign_node_ptr_->Subscribe("model" + name_space + ign_topic_sensor_pose_static_,
-                           IgnitionBridge::ignitionPoseStaticCallback);
+  subscribePoseStatic();
 
   return;
 };
 
+std::shared_ptr<SensorStats> IgnitionBridge::addSensorStats(const std::string &name) {
+  auto stats = sensor_stats_.find(name);
+  if (stats == sensor_stats_.end()) {
+    stats = sensor_stats_.insert(std::make_pair(name, std::make_shared<SensorStats>())).first;
+  }
+  return stats->second;
+};
+
+IgnitionBridge::~IgnitionBridge() {
+  // The node is also held by the sensor discovery and the replay, so it does not necessarily
+  // go away with this bridge
+  for (const auto &topic : subscribed_topics_) {
+    ign_node_ptr_->Unsubscribe(topic);
+  }
+  // Conversions still queued would call back into a platform that is going away
+  worker_pool_.reset();
+};
+
 void IgnitionBridge::sendTwistMsg(const geometry_msgs::msg::Twist &ros_twist_msg) {
-  ignition::msgs::Twist ign_twist_msg;
-  ros_ign_bridge::convert_ros_to_ign(ros_twist_msg, ign_twist_msg);
-  command_twist_pub_.Publish(ign_twist_msg);
+  ros_ign_bridge::convert_ros_to_ign(ros_twist_msg, command_twist_msg_);
+  command_twist_pub_.Publish(command_twist_msg_);
   return;
 };
 
@@ -124,9 +142,15 @@ void IgnitionBridge::setPoseCallback(poseCallbackType callback) {
 };
 
 void IgnitionBridge::ignitionPoseCallback(const ignition::msgs::Pose &msg) {
-  geometry_msgs::msg::PoseStamped pose_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, pose_msg);
-  poseCallback_(pose_msg);
+  if (!poseCallback_) {
+    return;
+  }
+  pose_stats_->recordReceived(msg.ByteSizeLong());
+  auto start = SensorStats::Clock::now();
+  ros_ign_bridge::convert_ign_to_ros(msg, pose_msg_);
+  auto converted = SensorStats::Clock::now();
+  poseCallback_(pose_msg_);
+  pose_stats_->recordPublished(start, converted, SensorStats::Clock::now());
   return;
 };
 
@@ -136,68 +160,70 @@ void IgnitionBridge::setOdometryCallback(odometryCallbackType callback) {
 };
 
 void IgnitionBridge::ignitionOdometryCallback(const ignition::msgs::Odometry &msg) {
-  nav_msgs::msg::Odometry odom_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, odom_msg);
-  odometryCallback_(odom_msg);
-  return;
-};
-
-void IgnitionBridge::setImuCallback(imuSensorCallbackType callback, std::string world_name) {
-  imuCallback_ = callback;
-  std::string ign_topic_sensor_imu = "/imu_sensor/imu";
-  std::string topic = "world/" + world_name + "/model" + name_space_ + "/link/base_link/sensor" +
-                      ign_topic_sensor_imu;
-  ign_node_ptr_->Subscribe(topic, IgnitionBridge::ignitionImuSensorCallback);
-  return;
-};
-
-void IgnitionBridge::ignitionImuSensorCallback(const ignition::msgs::IMU &msg) {
-  sensor_msgs::msg::Imu imu_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, imu_msg);
-  imuCallback_(imu_msg);
+  if (!odometryCallback_) {
+    return;
+  }
+  odometry_stats_->recordReceived(msg.ByteSizeLong());
+  auto start = SensorStats::Clock::now();
+  ros_ign_bridge::convert_ign_to_ros(msg, odometry_msg_);
+  auto converted = SensorStats::Clock::now();
+  odometryCallback_(odometry_msg_);
+  odometry_stats_->recordPublished(start, converted, SensorStats::Clock::now());
   return;
 };
 
-void IgnitionBridge::setAirPressureCallback(airPressureSensorCallbackType callback,
-                                            std::string world_name) {
-  airPressureCallback_ = callback;
-  std::string ign_topic_sensor_air_pressure = "/air_pressure/air_pressure";
-  std::string topic = "world/" + world_name + "/model" + name_space_ + "/link/base_link/sensor" +
-                      ign_topic_sensor_air_pressure;
-  ign_node_ptr_->Subscribe(topic, IgnitionBridge::ignitionAirPressureSensorCallback);
+void IgnitionBridge::setClockCallback(clockCallbackType callback) {
+  clockCallback_ = callback;
+  subscribe<ignition::msgs::Clock>(
+      ign_topic_clock_, [this](const ignition::msgs::Clock &msg) { ignitionClockCallback(msg); });
   return;
 };
 
-void IgnitionBridge::ignitionAirPressureSensorCallback(const ignition::msgs::FluidPressure &msg) {
-  sensor_msgs::msg::FluidPressure air_pressure_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, air_pressure_msg);
-  airPressureCallback_(air_pressure_msg);
+void IgnitionBridge::ignitionClockCallback(const ignition::msgs::Clock &msg) {
+  rosgraph_msgs::msg::Clock clock_msg;
+  ros_ign_bridge::convert_ign_to_ros(msg, clock_msg);
+  clockCallback_(clock_msg);
   return;
 };
 
-void IgnitionBridge::setMagnetometerCallback(magnetometerSensorCallbackType callback,
-                                             std::string world_name) {
-  magnetometerCallback_ = callback;
-  std::string ign_topic_sensor_magnetometer = "/magnetometer/magnetometer";
-  std::string topic = "world/" + world_name + "/model" + name_space_ + "/link/base_link/sensor" +
-                      ign_topic_sensor_magnetometer;
-  ign_node_ptr_->Subscribe(topic, IgnitionBridge::ignitionMagnetometerSensorCallback);
-  return;
+std::string IgnitionBridge::baseLinkSensorTopic(const std::string &world_name,
+                                                const std::string &sensor_name) const {
+  return "world/" + world_name + "/model" + name_space_ + "/link/base_link/sensor/" + sensor_name;
 };
 
-void IgnitionBridge::ignitionMagnetometerSensorCallback(const ignition::msgs::Magnetometer &msg) {
-  sensor_msgs::msg::MagneticField magnetometer_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, magnetometer_msg);
-  magnetometerCallback_(magnetometer_msg);
-  return;
+std::string IgnitionBridge::sensorTopic(const std::string &world_name,
+                                        const std::string &model_name,
+                                        const std::string &sensor_name,
+                                        const std::string &link_name,
+                                        const std::string &sensor_type) {
+  return "/world/" + world_name + "/model/" + model_name + "/model/" + sensor_name + "/link/" +
+         link_name + "/sensor/" + sensor_type;
 };
 
 void IgnitionBridge::ignitionPoseStaticCallback(const ignition::msgs::Pose_V &msg) {
-  tf2_msgs::msg::TFMessage pose_static_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, pose_static_msg);
+  // A sensor added since the last message may need a pose that is already cached
+  const uint64_t callbacks_version = transform_callbacks_version_.load(std::memory_order_acquire);
+  if (callbacks_version != static_poses_version_) {
+    static_poses_.clear();
+    static_poses_version_ = callbacks_version;
+  }
 
-  for (int i = 0; i < pose_static_msg.transforms.size(); i++) {
-    geometry_msgs::msg::TransformStamped transform_stamped = pose_static_msg.transforms[i];
+  for (const auto &pose : msg.pose()) {
+    // Static poses are republished unchanged, so only new or moved ones are converted
+    const std::array<double, 7> values = {pose.position().x(),    pose.position().y(),
+                                          pose.position().z(),    pose.orientation().x(),
+                                          pose.orientation().y(), pose.orientation().z(),
+                                          pose.orientation().w()};
+    if (!pose.name().empty()) {
+      auto cached = static_poses_.find(pose.name());
+      if (cached != static_poses_.end() && cached->second == values) {
+        continue;
+      }
+      static_poses_[pose.name()] = values;
+    }
+
+    geometry_msgs::msg::TransformStamped transform_stamped;
+    ros_ign_bridge::convert_ign_to_ros(pose, transform_stamped);
     if (("/" + transform_stamped.header.frame_id) == name_space_ &&
         ("/" + transform_stamped.child_frame_id) != (name_space_ + "/base_link")) {
       std::string parent_id = transform_stamped.header.frame_id;
@@ -207,158 +233,227 @@ void IgnitionBridge::ignitionPoseStaticCallback(const ignition::msgs::Pose_V &ms
       transform_stamped.header.frame_id = name_space_ + "/base_link";
       transform_stamped.child_frame_id = name_space_ + "/" + sensor_name;
 
-      auto callback = callbacks_sensors_transform_.find(sensor_name);
-      if (callback != callbacks_sensors_transform_.end()) {
-        callback->second(transform_stamped, sensor_name);
+      // Sensors may be added from the ROS thread while this runs, the callback is called unlocked
+      tfCallbackType callback;
+      {
+        std::lock_guard<std::mutex> lock(transform_mutex_);
+        auto it = callbacks_sensors_transform_.find(sensor_name);
+        if (it == callbacks_sensors_transform_.end()) {
+          continue;
+        }
+        callback = it->second;
       }
+      callback(transform_stamped, sensor_name);
     }
   }
   return;
 };
 
-void IgnitionBridge::unsuscribePoseStatic() {
-  std::string topic = "model" + name_space_ + "/pose_static";
-  ign_node_ptr_->Unsubscribe(topic);
+void IgnitionBridge::addTransformCallback(const std::string &sensor_name,
+                                          tfCallbackType poseStaticCallback) {
+  std::lock_guard<std::mutex> lock(transform_mutex_);
+  callbacks_sensors_transform_.insert(std::make_pair(sensor_name, poseStaticCallback));
+  transform_callbacks_version_.fetch_add(1, std::memory_order_release);
   return;
 };
 
-// Cameras
-void IgnitionBridge::addSensor(std::string world_name, std::string name_space,
-                               std::string sensor_name, std::string link_name,
-                               std::string sensor_type, cameraCallbackType cameraCallback,
-                               cameraInfoCallbackType cameraInfoCallback,
-                               tfCallbackType poseStaticCallback) {
-  std::string camera_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                             sensor_name + "/link/" + link_name + "/sensor/" + sensor_type +
-                             "/image";
-  callbacks_camera_.insert(std::make_pair(camera_topic, cameraCallback));
-  callbacks_sensors_names_.insert(std::make_pair(camera_topic, sensor_name));
-  ign_node_ptr_->Subscribe(camera_topic, IgnitionBridge::ignitionCameraCallback);
-
-  std::string camera_info_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                                  sensor_name + "/link/" + link_name + "/sensor/" + sensor_type +
-                                  "/camera_info";
-  callbacks_camera_info_.insert(std::make_pair(camera_info_topic, cameraInfoCallback));
-  callbacks_sensors_names_.insert(std::make_pair(camera_info_topic, sensor_name));
-  ign_node_ptr_->Subscribe(camera_info_topic, IgnitionBridge::ignitionCameraInfoCallback);
-
-  callbacks_sensors_transform_.insert(std::make_pair(sensor_name, poseStaticCallback));
+void IgnitionBridge::setConversionThreads(size_t threads) {
+  conversion_threads_ = threads;
   return;
 };
 
-void IgnitionBridge::ignitionCameraCallback(const ignition::msgs::Image &msg,
-                                            const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::Image ros_image_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, ros_image_msg);
-  auto callback = callbacks_camera_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-
-  if (callback != callbacks_camera_.end()) {
-    callback->second(ros_image_msg, sensor_name->second);
+WorkerPool &IgnitionBridge::workerPool() {
+  if (!worker_pool_) {
+    // One core is left to the ignition transport thread. On a single core the workers could only
+    // take turns with it, adding a copy of every message and delaying the inline streams.
+    size_t threads = conversion_threads_;
+    const unsigned int cores = std::thread::hardware_concurrency();
+    if (cores > 0) {
+      threads = std::min<size_t>(threads, cores - 1);
+    }
+    worker_pool_ = std::make_unique<WorkerPool>(threads);
   }
-  return;
+  return *worker_pool_;
 };
 
-void IgnitionBridge::ignitionCameraInfoCallback(const ignition::msgs::CameraInfo &msg,
-                                                const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::CameraInfo ros_camera_info_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, ros_camera_info_msg);
-  auto callback = callbacks_camera_info_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-
-  if (callback != callbacks_camera_info_.end()) {
-    callback->second(ros_camera_info_msg, sensor_name->second);
+bool IgnitionBridge::setSensorDemand(const std::string &name, bool demand) {
+  auto subscription = on_demand_subscriptions_.find(name);
+  if (subscription == on_demand_subscriptions_.end() || subscription->second.active == demand) {
+    return false;
   }
-  return;
+  subscription->second.activate(demand);
+  subscription->second.active = demand;
+  return true;
 };
 
-void IgnitionBridge::addSensor(std::string world_name, std::string name_space,
-                               std::string sensor_name, std::string link_name,
-                               std::string sensor_type, laserScanCallbackType laserScanCallback,
-                               pointCloudCallbackType pointCloudCallback,
-                               tfCallbackType poseStaticCallback) {
-  std::string laser_scan_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                                 sensor_name + "/link/" + link_name + "/sensor/" + sensor_type +
-                                 "/scan";
-  callbacks_laser_scan_.insert(std::make_pair(laser_scan_topic, laserScanCallback));
-  callbacks_sensors_names_.insert(std::make_pair(laser_scan_topic, sensor_name));
-  ign_node_ptr_->Subscribe(laser_scan_topic, IgnitionBridge::ignitionLaserScanCallback);
-
-  std::string point_cloud_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                                  sensor_name + "/link/" + link_name + "/sensor/" + sensor_type +
-                                  "/scan/points";
-  callbacks_point_cloud_.insert(std::make_pair(point_cloud_topic, pointCloudCallback));
-  callbacks_sensors_names_.insert(std::make_pair(point_cloud_topic, sensor_name));
-  ign_node_ptr_->Subscribe(point_cloud_topic, IgnitionBridge::ignitionPointCloudCallback);
+void IgnitionBridge::addDerivedStream(const std::string &name,
+                                      std::shared_ptr<std::atomic<bool>> enabled) {
+  OnDemandSubscription subscription;
+  subscription.activate = [enabled](bool active) {
+    enabled->store(active, std::memory_order_relaxed);
+  };
+  on_demand_subscriptions_.emplace(name, subscription);
+  return;
+};
 
-  callbacks_sensors_transform_.insert(std::make_pair(sensor_name, poseStaticCallback));
+void IgnitionBridge::unsubscribe(const std::string &topic) {
+  ign_node_ptr_->Unsubscribe(topic);
+  subscribed_topics_.erase(
+      std::remove(subscribed_topics_.begin(), subscribed_topics_.end(), topic),
+      subscribed_topics_.end());
   return;
 };
 
-void IgnitionBridge::ignitionLaserScanCallback(const ignition::msgs::LaserScan &msg,
-                                               const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::LaserScan ros_laser_scan_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, ros_laser_scan_msg);
-  auto callback = callbacks_laser_scan_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-  if (callback != callbacks_laser_scan_.end()) {
-    callback->second(ros_laser_scan_msg, sensor_name->second);
+void IgnitionBridge::subscribePoseStatic() {
+  if (pose_static_subscribed_) {
+    return;
   }
+  subscribe<ignition::msgs::Pose_V>(
+      "model" + name_space_ + ign_topic_sensor_pose_static_,
+      [this](const ignition::msgs::Pose_V &msg) { ignitionPoseStaticCallback(msg); });
+  pose_static_subscribed_ = true;
   return;
 };
 
-void IgnitionBridge::ignitionPointCloudCallback(const ignition::msgs::PointCloudPacked &msg,
-                                                const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::PointCloud2 ros_point_cloud_msg;
-  ros_ign_bridge::convert_ign_to_ros(msg, ros_point_cloud_msg);
-  auto callback = callbacks_point_cloud_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-  if (callback != callbacks_point_cloud_.end()) {
-    callback->second(ros_point_cloud_msg, sensor_name->second);
+void IgnitionBridge::unsuscribePoseStatic() {
+  if (!pose_static_subscribed_) {
+    return;
   }
+  unsubscribe("model" + name_space_ + ign_topic_sensor_pose_static_);
+  pose_static_subscribed_ = false;
   return;
 };
 
-void IgnitionBridge::addSensor(std::string world_name, std::string name_space,
-                               std::string sensor_name, std::string link_name,
-                               std::string sensor_type, gpsCallbackType gpsCallback,
-                               tfCallbackType poseStaticCallback) {
-  std::string gps_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                          sensor_name + "/link/" + link_name + "/sensor/" + sensor_type + "/navsat";
-  callbacks_gps_.insert(std::make_pair(gps_topic, gpsCallback));
-  callbacks_sensors_names_.insert(std::make_pair(gps_topic, sensor_name));
-  ign_node_ptr_->Subscribe(gps_topic, IgnitionBridge::ignitionGPSCallback);
+// Cameras
+void IgnitionBridge::addCameraStreams(
+    const std::string &topic, const std::string &sensor_name,
+    std::function<void(const ignition::msgs::Image &)> convertImage,
+    std::function<void(const ignition::msgs::CameraInfo &)> convertCameraInfo,
+    tfCallbackType poseStaticCallback, const StreamPolicy &policy) {
+  auto camera_stats = addSensorStats(sensor_name);
+  // Frames over the rate are dropped before conversion, the rest are converted on the worker
+  // pool in order. With latest_only frames arriving meanwhile replace each other instead of queuing
+  auto rate_limiter = std::make_shared<RateLimiter>(policy.max_rate);
+  auto camera_strand = std::make_shared<Strand<ignition::msgs::Image>>(
+      workerPool(), policy.latest_only ? 1 : policy.queue_size, std::move(convertImage));
+  std::function<void(const ignition::msgs::Image &)> camera_handler =
+      [camera_strand, rate_limiter, camera_stats](const ignition::msgs::Image &msg) {
+        camera_stats->recordReceived(msg.ByteSizeLong());
+        if (!rate_limiter->accept(stampNs(msg.header()))) {
+          camera_stats->recordDropped();
+          return;
+        }
+        if (!camera_strand->push(msg)) {
+          camera_stats->recordDropped();
+        }
+      };
+  subscribeOnDemand(sensor_name, topic + SensorStream<ignition::msgs::Image>::suffix,
+                    camera_handler);
+
+  auto camera_info_stats = addSensorStats(sensor_name + "/camera_info");
+  // The platform keeps the last camera_info and restamps it with every image, so it is only
+  // converted again when the calibration changes
+  auto last_camera_info = std::make_shared<ignition::msgs::CameraInfo>();
+  std::function<void(const ignition::msgs::CameraInfo &)> camera_info_handler =
+      [convertCameraInfo, camera_info_stats,
+       last_camera_info](const ignition::msgs::CameraInfo &msg) {
+        camera_info_stats->recordReceived(msg.ByteSizeLong());
+        if (last_camera_info->width() != 0 && sameCalibration(msg, *last_camera_info)) {
+          return;
+        }
+        last_camera_info->CopyFrom(msg);
+        convertCameraInfo(msg);
+      };
+  subscribeOnDemand(sensor_name + "/camera_info",
+                    topic + SensorStream<ignition::msgs::CameraInfo>::suffix, camera_info_handler);
+
+  addTransformCallback(sensor_name, poseStaticCallback);
+  return;
+};
 
-  callbacks_sensors_transform_.insert(std::make_pair(sensor_name, poseStaticCallback));
+// Lidars
+void IgnitionBridge::addLidarStreams(
+    const std::string &topic, const std::string &sensor_name,
+    std::function<void(const ignition::msgs::LaserScan &)> convertScan,
+    std::function<void(const ignition::msgs::LaserScan &)> projectPoints,
+    std::function<void(const ignition::msgs::PointCloudPacked &)> convertPoints,
+    tfCallbackType poseStaticCallback) {
+  auto laser_scan_stats = addSensorStats(sensor_name);
+  auto point_cloud_stats = addSensorStats(sensor_name + "/points");
+  // Scans and clouds are converted on the worker pool, each stream in order
+  const size_t queue_size = StreamPolicy().queue_size;
+
+  std::function<void(const ignition::msgs::LaserScan &)> scan_work = std::move(convertScan);
+  auto points_enabled = std::make_shared<std::atomic<bool>>(false);
+  if (projectPoints) {
+    // Only the scan crosses ignition transport, the cloud is projected from its ranges while
+    // the points are in demand
+    scan_work = [convertScan = std::move(scan_work), projectPoints = std::move(projectPoints),
+                 points_enabled](const ignition::msgs::LaserScan &msg) {
+      convertScan(msg);
+      if (points_enabled->load(std::memory_order_relaxed)) {
+        projectPoints(msg);
+      }
+    };
+  }
+  auto laser_scan_strand = std::make_shared<Strand<ignition::msgs::LaserScan>>(
+      workerPool(), queue_size, std::move(scan_work));
+  std::function<void(const ignition::msgs::LaserScan &)> laser_scan_handler =
+      [laser_scan_strand, laser_scan_stats](const ignition::msgs::LaserScan &msg) {
+        laser_scan_stats->recordReceived(msg.ByteSizeLong());
+        if (!laser_scan_strand->push(msg)) {
+          laser_scan_stats->recordDropped();
+        }
+      };
+  subscribeOnDemand(sensor_name, topic + SensorStream<ignition::msgs::LaserScan>::suffix,
+                    laser_scan_handler);
+
+  if (!convertPoints) {
+    addDerivedStream(sensor_name + "/points", points_enabled);
+    addTransformCallback(sensor_name, poseStaticCallback);
+    return;
+  }
+
+  auto point_cloud_strand = std::make_shared<Strand<ignition::msgs::PointCloudPacked>>(
+      workerPool(), queue_size, std::move(convertPoints));
+  std::function<void(const ignition::msgs::PointCloudPacked &)> point_cloud_handler =
+      [point_cloud_strand, point_cloud_stats](const ignition::msgs::PointCloudPacked &msg) {
+        point_cloud_stats->recordReceived(msg.ByteSizeLong());
+        if (!point_cloud_strand->push(msg)) {
+          point_cloud_stats->recordDropped();
+        }
+      };
+  subscribeOnDemand(sensor_name + "/points",
+                    topic + SensorStream<ignition::msgs::PointCloudPacked>::suffix,
+                    point_cloud_handler);
+
+  addTransformCallback(sensor_name, poseStaticCallback);
   return;
 };
 
-std::string replace_delimiter(const std::string &input, const std::string &old_delim,
-                              const std::string new_delim) {
-  std::string output;
-  output.reserve(input.size());
+// Writes into output so that its capacity is reused between messages
+static void replaceDelimiter(const std::string &input, const char *old_delim,
+                             const char *new_delim, std::string &output) {
+  const std::size_t old_size = std::strlen(old_delim);
+  output.clear();
 
   std::size_t last_pos = 0;
-
   while (last_pos < input.size()) {
     std::size_t pos = input.find(old_delim, last_pos);
-    output += input.substr(last_pos, pos - last_pos);
+    output.append(input, last_pos, pos == std::string::npos ? std::string::npos : pos - last_pos);
     if (pos != std::string::npos) {
-      output += new_delim;
-      pos += old_delim.size();
+      output.append(new_delim);
+      pos += old_size;
     }
     last_pos = pos;
   }
-  return output;
+  return;
 };
 
-void IgnitionBridge::ignitionGPSCallback(const ignition::msgs::NavSat &ign_msg,
-                                         const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::NavSatFix ros_msg;
-  // ros_ign_bridge::convert_ign_to_ros(msg, ros_gps_msg);
-
+void SensorStream<ignition::msgs::NavSat>::convert(const ignition::msgs::NavSat &ign_msg,
+                                                   sensor_msgs::msg::NavSatFix &ros_msg) {
   ros_ign_bridge::convert_ign_to_ros(ign_msg.header(), ros_msg.header);
-  ros_msg.header.frame_id = replace_delimiter(ign_msg.frame_id(), "::", "/");
+  replaceDelimiter(ign_msg.frame_id(), "::", "/", ros_msg.header.frame_id);
   ros_msg.latitude = ign_msg.latitude_deg();
   ros_msg.longitude = ign_msg.longitude_deg();
   ros_msg.altitude = ign_msg.altitude();
@@ -366,94 +461,6 @@ void IgnitionBridge::ignitionGPSCallback(const ignition::msgs::NavSat &ign_msg,
   // position_covariance is not supported in Ignition::Msgs::NavSat.
   ros_msg.position_covariance_type = sensor_msgs::msg::NavSatFix::COVARIANCE_TYPE_UNKNOWN;
   ros_msg.status.status = sensor_msgs::msg::NavSatStatus::STATUS_FIX;
-
-  auto callback = callbacks_gps_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-  if (callback != callbacks_gps_.end()) {
-    callback->second(ros_msg, sensor_name->second);
-  }
-  return;
-};
-
-void IgnitionBridge::addSensor(std::string world_name, std::string name_space,
-                               std::string sensor_name, std::string link_name,
-                               std::string sensor_type, imuCallbackType imuCallback,
-                               tfCallbackType poseStaticCallback) {
-  std::string imu_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                          sensor_name + "/link/" + link_name + "/sensor/" + sensor_type + "/navsat";
-  callbacks_imu_.insert(std::make_pair(imu_topic, imuCallback));
-  callbacks_sensors_names_.insert(std::make_pair(imu_topic, sensor_name));
-  ign_node_ptr_->Subscribe(imu_topic, IgnitionBridge::ignitionGPSCallback);
-
-  callbacks_sensors_transform_.insert(std::make_pair(sensor_name, poseStaticCallback));
-  return;
-};
-
-void IgnitionBridge::ignitionImuCallback(const ignition::msgs::IMU &ign_msg,
-                                         const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::Imu ros_imu_msg;
-  ros_ign_bridge::convert_ign_to_ros(ign_msg, ros_imu_msg);
-  auto callback = callbacks_imu_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-  if (callback != callbacks_imu_.end()) {
-    callback->second(ros_imu_msg, sensor_name->second);
-  }
-  return;
-};
-
-void IgnitionBridge::addSensor(std::string world_name, std::string name_space,
-                               std::string sensor_name, std::string link_name,
-                               std::string sensor_type,
-                               airPressureCallbackType air_pressureCallback,
-                               tfCallbackType poseStaticCallback) {
-  std::string air_pressure_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                                   sensor_name + "/link/" + link_name + "/sensor/" + sensor_type +
-                                   "/navsat";
-  callbacks_air_pressure_.insert(std::make_pair(air_pressure_topic, air_pressureCallback));
-  callbacks_sensors_names_.insert(std::make_pair(air_pressure_topic, sensor_name));
-  ign_node_ptr_->Subscribe(air_pressure_topic, IgnitionBridge::ignitionGPSCallback);
-
-  callbacks_sensors_transform_.insert(std::make_pair(sensor_name, poseStaticCallback));
-  return;
-};
-
-void IgnitionBridge::ignitionAirPressureCallback(const ignition::msgs::FluidPressure &ign_msg,
-                                                 const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::FluidPressure ros_air_pressure_msg;
-  ros_ign_bridge::convert_ign_to_ros(ign_msg, ros_air_pressure_msg);
-  auto callback = callbacks_air_pressure_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-  if (callback != callbacks_air_pressure_.end()) {
-    callback->second(ros_air_pressure_msg, sensor_name->second);
-  }
-  return;
-};
-
-void IgnitionBridge::addSensor(std::string world_name, std::string name_space,
-                               std::string sensor_name, std::string link_name,
-                               std::string sensor_type,
-                               magnetometerCallbackType magnetometerCallback,
-                               tfCallbackType poseStaticCallback) {
-  std::string magnetometer_topic = "/world/" + world_name + "/model/" + name_space + "/model/" +
-                                   sensor_name + "/link/" + link_name + "/sensor/" + sensor_type +
-                                   "/navsat";
-  callbacks_magnetometer_.insert(std::make_pair(magnetometer_topic, magnetometerCallback));
-  callbacks_sensors_names_.insert(std::make_pair(magnetometer_topic, sensor_name));
-  ign_node_ptr_->Subscribe(magnetometer_topic, IgnitionBridge::ignitionGPSCallback);
-
-  callbacks_sensors_transform_.insert(std::make_pair(sensor_name, poseStaticCallback));
-  return;
-};
-
-void IgnitionBridge::ignitionMagnometerCallback(const ignition::msgs::Magnetometer &ign_msg,
-                                                const ignition::transport::MessageInfo &msg_info) {
-  sensor_msgs::msg::MagneticField ros_magnetometer_msg;
-  ros_ign_bridge::convert_ign_to_ros(ign_msg, ros_magnetometer_msg);
-  auto callback = callbacks_magnetometer_.find(msg_info.Topic());
-  auto sensor_name = callbacks_sensors_names_.find(msg_info.Topic());
-  if (callback != callbacks_magnetometer_.end()) {
-    callback->second(ros_magnetometer_msg, sensor_name->second);
-  }
   return;
 };
 }  // namespace ignition_platform
@@ -35,42 +35,133 @@
  ********************************************************************************/
 
 #include "ignition_platform.hpp"
+#include "image_kernels.hpp"
+
+#include <rclcpp_components/register_node_macro.hpp>
 
 namespace ignition_platform
 {
-    std::shared_ptr<IgnitionBridge> IgnitionPlatform::ignition_bridge_ = nullptr;
-    bool IgnitionPlatform::odometry_info_received_ = false;
-    geometry_msgs::msg::Quaternion IgnitionPlatform::self_orientation_ = geometry_msgs::msg::Quaternion();
-    std::string IgnitionPlatform::namespace_ = "";
-
-    std::unique_ptr<as2::sensors::Sensor<geometry_msgs::msg::PoseStamped>> IgnitionPlatform::pose_ptr_ = nullptr;
-    std::unique_ptr<as2::sensors::Sensor<nav_msgs::msg::Odometry>> IgnitionPlatform::odometry_raw_estimation_ptr_ = nullptr;
-
-    std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::Imu>> IgnitionPlatform::imu_ptr_ = nullptr;
-    std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::FluidPressure>> IgnitionPlatform::air_pressure_ptr_ = nullptr;
-    std::unique_ptr<as2::sensors::Sensor<sensor_msgs::msg::MagneticField>> IgnitionPlatform::magnetometer_ptr_ = nullptr;
-
-    std::unordered_map<std::string, bool> IgnitionPlatform::callbacks_tf_ = {};
-    std::unordered_map<std::string, as2::sensors::Camera> IgnitionPlatform::callbacks_camera_ = {};
-    std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::LaserScan>> IgnitionPlatform::callbacks_laser_scan_ = {};
-    std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::PointCloud2>> IgnitionPlatform::callbacks_point_cloud_ = {};
-    std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::NavSatFix>> IgnitionPlatform::callbacks_gps_ = {};
-    std::unordered_map<std::string, as2::sensors::Sensor<sensor_msgs::msg::Imu>> IgnitionPlatform::callbacks_imu_ = {};
-
-    IgnitionPlatform::IgnitionPlatform() : as2::AerialPlatform()
+    IgnitionPlatform::IgnitionPlatform(const rclcpp::NodeOptions &options)
+        : as2::AerialPlatform(options)
     {
-        this->declare_parameter<std::string>("sensors");
+        this->declare_parameter<std::string>("sensors", "");
+        this->declare_parameter<std::string>("bundles", "");
+        this->declare_parameter<double>("sensor_discovery_period", 1.0);
+        this->declare_parameter<bool>("lazy_subscriptions", true);
+        this->declare_parameter<double>("camera_max_rate", 0.0);
+        this->declare_parameter<bool>("camera_latest_only", true);
+        this->declare_parameter<bool>("lidar_points_from_scan", false);
+        this->declare_parameter<double>("static_tf_timeout", 10.0);
+        this->declare_parameter<std::string>("record_path", "");
+        this->declare_parameter<int64_t>("record_segment_size", 256);
+        this->declare_parameter<std::string>("replay_path", "");
+        this->declare_parameter<double>("replay_speed", 1.0);
+        this->declare_parameter<double>("replay_start_delay", 2.0);
         namespace_ = this->get_namespace();
-        ignition_bridge_ = std::make_shared<IgnitionBridge>(namespace_);
+        odom_frame_id_ = generateTfName(namespace_, "odom");
+        imu_frame_id_ = generateTfName(namespace_, "imu");
+        air_pressure_frame_id_ = generateTfName(namespace_, "air_pressure");
+        magnetometer_frame_id_ = generateTfName(namespace_, "magnetometer");
+        // Static transforms of the cameras and lidars, whose data have publishers of their own
+        static_tf_broadcaster_ = std::make_shared<tf2_ros::StaticTransformBroadcaster>(this);
+        // Raw ignition messages recorded to "<record_path>.<n>" segments of record_segment_size MiB
+        std::string record_path = this->get_parameter("record_path").as_string();
+        if (!record_path.empty())
+        {
+            recorder_ = std::make_shared<StreamRecorder>(
+                record_path,
+                static_cast<size_t>(this->get_parameter("record_segment_size").as_int()) << 20);
+            RCLCPP_INFO(this->get_logger(), "Recording ignition messages to %s", record_path.c_str());
+        }
+        ignition_bridge_ = std::make_shared<IgnitionBridge>(namespace_, recorder_);
+        this->declare_parameter<int64_t>("conversion_threads", 0);
+        ignition_bridge_->setConversionThreads(this->get_parameter("conversion_threads").as_int());
+
+        // The control path stays in the default group, together with the AS2 arming, offboard and
+        // control mode services whose state it shares. Sensor bookkeeping shares the sensor maps
+        // instead, so it gets its own exclusive group and, on a multi-threaded executor, neither
+        // waits for the other. Reports only read atomic counters.
+        this->declare_parameter<int64_t>("executor_threads", 2);
+        sensor_callback_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+        report_callback_group_ = this->create_callback_group(rclcpp::CallbackGroupType::Reentrant);
+
+        this->declare_parameter<double>("cmd_freq", kDefaultCmdFreq);
+        this->declare_parameter<double>("platform_freq", kDefaultPlatformFreq);
+        this->declare_parameter<bool>("event_driven_commands", false);
+        this->declare_parameter<bool>("publish_clock", false);
+        double cmd_freq = timerRate("cmd_freq", kDefaultCmdFreq);
+        double platform_freq = timerRate("platform_freq", kDefaultPlatformFreq);
+        event_driven_commands_ = this->get_parameter("event_driven_commands").as_bool();
 
         this->configureSensors();
 
-        // Timer to send command
-        static auto timer_commands_ =
-            this->create_wall_timer(
-                std::chrono::milliseconds(CMD_FREQ),
+        // Sensor bookkeeping runs in the platform loop. Like the command timer it is on the node
+        // clock, so the rate is per simulated second with use_sim_time and per second otherwise
+        timer_platform_ =
+            rclcpp::create_timer(
+                this,
+                this->get_clock(),
+                rclcpp::Duration::from_seconds(1.0 / platform_freq),
+                [this]()
+                { this->platformLoop(); },
+                sensor_callback_group_);
+
+        // Republish the ignition clock for setups where nothing else bridges it, so that
+        // use_sim_time makes the platform follow the simulation
+        if (this->get_parameter("publish_clock").as_bool())
+        {
+            clock_pub_ = this->create_publisher<rosgraph_msgs::msg::Clock>("/clock", rclcpp::QoS(10));
+            ignition_bridge_->setClockCallback(
+                [this](rosgraph_msgs::msg::Clock &msg)
+                { clock_pub_->publish(msg); });
+        }
+
+        // as2::AerialPlatform subscribes to the twist commands and the command timer forwards the
+        // last one. It does not report their arrival, so only in event driven mode the platform
+        // subscribes too, to timestamp each command and send it through sendCommand right away.
+        if (event_driven_commands_)
+        {
+            twist_command_sub_ = this->create_subscription<geometry_msgs::msg::TwistStamped>(
+                as2_names::topics::actuator_command::twist,
+                as2_names::topics::actuator_command::qos,
+                std::bind(&IgnitionPlatform::twistCommandCallback, this, std::placeholders::_1));
+        }
+
+        // Timer to send command. It acts as a keep-alive in event driven mode. It runs on the node
+        // clock, so with use_sim_time it follows the simulation rate and stops while it is paused
+        timer_commands_ =
+            rclcpp::create_timer(
+                this->get_node_base_interface(),
+                this->get_node_timers_interface(),
+                this->get_clock(),
+                rclcpp::Duration::from_seconds(1.0 / cmd_freq),
                 [this]()
                 { this->sendCommand(); });
+
+        this->declare_parameter<double>("stats_period", 1.0);
+        double stats_period = this->get_parameter("stats_period").as_double();
+        if (stats_period > 0.0)
+        {
+            diagnostics_pub_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+                "/diagnostics", rclcpp::QoS(10));
+            timer_stats_ =
+                this->create_wall_timer(
+                    std::chrono::duration<double>(stats_period),
+                    [this]()
+                    { this->publishSensorStats(); },
+                    sensor_callback_group_);
+        }
+
+        // Arrival is only known for the commands the platform subscribes to itself
+        if (event_driven_commands_)
+        {
+            timer_latency_report_ =
+                this->create_wall_timer(
+                    std::chrono::seconds(10),
+                    [this]()
+                    { this->reportCommandLatency(); },
+                    report_callback_group_);
+        }
     };
 
     std::vector<std::string> split(const std::string &s, char delim)
@@ -85,29 +176,186 @@ namespace ignition_platform
         return elems;
     };
 
-    void IgnitionPlatform::configureSensors()
+    std::string sensorTopic(const std::string &sensor_name)
     {
-        pose_ptr_ =
-            std::make_unique<as2::sensors::Sensor<geometry_msgs::msg::PoseStamped>>("pose", this);
-        ignition_bridge_->setPoseCallback(poseCallback);
+        return std::string(as2_names::topics::sensor_measurements::base) + sensor_name;
+    };
 
-        odometry_raw_estimation_ptr_ =
-            std::make_unique<as2::sensors::Sensor<nav_msgs::msg::Odometry>>(
-                "odom", this);
-        ignition_bridge_->setOdometryCallback(odometryCallback);
+    struct QoSDefaults
+    {
+        const char *reliability;
+        int64_t depth;
+        const char *durability;
+    };
 
-        std::string sensors_param = this->get_parameter("sensors").as_string();
+    // Images and clouds are only useful while fresh, so a slow subscriber gets the newest one
+    // instead of making the publisher retransmit and hold older ones. Vehicle state is not lost.
+    QoSDefaults qosDefaults(const std::string &sensor_type)
+    {
+        if (sensor_type == "camera" || sensor_type == "lidar")
+        {
+            return {"best_effort", 1, "volatile"};
+        }
+        // Vehicle state and bundles feed estimators that should not miss any of them
+        if (sensor_type == "odometry" || sensor_type == "pose" || sensor_type == "bundle")
+        {
+            return {"reliable", 10, "volatile"};
+        }
+        // Same as as2_names::topics::sensor_measurements::qos
+        return {"best_effort", 5, "volatile"};
+    };
 
-        std::vector<std::string> sensor_config_list = split(sensors_param, ':');
+    rclcpp::QoS IgnitionPlatform::sensorQoS(const std::string &sensor_type, const std::string &sensor_name)
+    {
+        const QoSDefaults defaults = qosDefaults(sensor_type);
+        const std::string type_prefix = "qos." + sensor_type + ".";
+        const std::string name_prefix = sensor_name + ".qos.";
+        std::string reliability = sensorParameter<std::string>(
+            name_prefix + "reliability",
+            sensorParameter<std::string>(type_prefix + "reliability", defaults.reliability));
+        const int64_t depth = sensorParameter<int64_t>(
+            name_prefix + "depth",
+            sensorParameter<int64_t>(type_prefix + "depth", defaults.depth));
+        std::string durability = sensorParameter<std::string>(
+            name_prefix + "durability",
+            sensorParameter<std::string>(type_prefix + "durability", defaults.durability));
+
+        if (reliability != "reliable" && reliability != "best_effort")
+        {
+            RCLCPP_WARN(this->get_logger(), "Invalid QoS reliability for %s: %s",
+                        sensor_name.c_str(), reliability.c_str());
+            reliability = defaults.reliability;
+        }
+        if (durability != "volatile" && durability != "transient_local")
+        {
+            RCLCPP_WARN(this->get_logger(), "Invalid QoS durability for %s: %s",
+                        sensor_name.c_str(), durability.c_str());
+            durability = defaults.durability;
+        }
 
-        std::string world_name = "";
+        // A depth of 0 keeps all messages, which grows without bound behind a slow reliable subscriber
+        rclcpp::QoS qos = depth > 0 ? rclcpp::QoS(rclcpp::KeepLast(depth)) : rclcpp::QoS(rclcpp::KeepAll());
+        if (reliability == "reliable")
+        {
+            qos.reliable();
+        }
+        else
+        {
+            qos.best_effort();
+        }
+        if (durability == "transient_local")
+        {
+            qos.transient_local();
+        }
+        else
+        {
+            qos.durability_volatile();
+        }
+        return qos;
+    };
 
-        for (auto sensor_config : sensor_config_list)
+    void IgnitionPlatform::configureBundles()
+    {
+        // "stereo:vio" with the sensor names of each bundle in "<bundle>.exact" and "<bundle>.window"
+        for (const auto &name : split(this->get_parameter("bundles").as_string(), ':'))
         {
-            std::vector<std::string> sensor_config_params = split(sensor_config, ',');
+            auto exact = sensorParameter<std::vector<std::string>>(name + ".exact", {});
+            auto window = sensorParameter<std::vector<std::string>>(name + ".window", {});
+            if (exact.empty())
+            {
+                RCLCPP_WARN(this->get_logger(), "Bundle %s has no exact members, ignoring it", name.c_str());
+                continue;
+            }
+            bundles_.emplace_back(std::make_shared<SensorBundle>(
+                name, exact, window,
+                std::max<int64_t>(sensorParameter<int64_t>(name + ".buffer_size", 4), 1),
+                std::max<int64_t>(sensorParameter<int64_t>(name + ".window_size", 256), 1)));
+        }
+        return;
+    };
+
+    template <typename MessageT>
+    std::function<void(const MessageT &)> IgnitionPlatform::bundleFeed(const std::string &sensor_name,
+                                                                       const std::string &topic_suffix)
+    {
+        std::vector<std::function<void(const MessageT &)>> feeds;
+        for (const auto &bundle : bundles_)
+        {
+            if (!bundle->contains(sensor_name))
+            {
+                continue;
+            }
+            rclcpp::QoS qos = sensorQoS("bundle", bundle->name());
+            // A window goes out in one burst right before the message closing it
+            if (bundle->isWindow(sensor_name))
+            {
+                qos.keep_last(bundle->windowSize());
+            }
+            auto publisher = this->create_publisher<MessageT>(
+                sensorTopic(bundle->name() + "/" + sensor_name) + topic_suffix, qos);
+            feeds.emplace_back(bundle->addMember<MessageT>(
+                sensor_name,
+                [publisher](const MessageT &msg)
+                { publisher->publish(msg); }));
+        }
 
-            world_name = sensor_config_params[0];
+        if (feeds.empty())
+        {
+            return nullptr;
+        }
+        bundled_sensors_.insert(sensor_name);
+        if (feeds.size() == 1)
+        {
+            return feeds.front();
+        }
+        return [feeds](const MessageT &msg)
+        {
+            for (const auto &feed : feeds)
+            {
+                feed(msg);
+            }
+        };
+    };
 
+    void IgnitionPlatform::configureSensors()
+    {
+        configureBundles();
+
+        pose_pub_ = this->create_publisher<geometry_msgs::msg::PoseStamped>(
+            sensorTopic("pose"), sensorQoS("pose", "pose"));
+        auto pose_bundle = bundleFeed<geometry_msgs::msg::PoseStamped>("pose");
+        ignition_bridge_->setPoseCallback(
+            [this, pose_bundle](geometry_msgs::msg::PoseStamped &msg)
+            {
+                poseCallback(msg);
+                if (pose_bundle)
+                {
+                    pose_bundle(msg);
+                }
+            });
+
+        odometry_pub_ = this->create_publisher<nav_msgs::msg::Odometry>(
+            sensorTopic("odom"), sensorQoS("odometry", "odom"));
+        auto odometry_bundle = bundleFeed<nav_msgs::msg::Odometry>("odom");
+        ignition_bridge_->setOdometryCallback(
+            [this, odometry_bundle](nav_msgs::msg::Odometry &msg)
+            {
+                odometryCallback(msg);
+                if (odometry_bundle)
+                {
+                    odometry_bundle(msg);
+                }
+            });
+
+        lazy_subscriptions_ = this->get_parameter("lazy_subscriptions").as_bool();
+        static_tf_timeout_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(this->get_parameter("static_tf_timeout").as_double()));
+        std::string sensors_param = this->get_parameter("sensors").as_string();
+
+        // Explicit "world,model,sensor,link,type:..." list, mainly kept for backwards compatibility
+        for (auto sensor_config : split(sensors_param, ':'))
+        {
+            std::vector<std::string> sensor_config_params = split(sensor_config, ',');
             if (sensor_config_params.size() != 5)
             {
                 RCLCPP_ERROR_ONCE(this->get_logger(), "Wrong sensor configuration: %s",
@@ -115,147 +363,558 @@ namespace ignition_platform
                 continue;
             }
 
-            std::string sensor_type = sensor_config_params[4];
-            if (sensor_type == "camera")
+            SensorConfig config;
+            config.world_name = sensor_config_params[0];
+            config.model_name = sensor_config_params[1];
+            config.sensor_name = sensor_config_params[2];
+            config.link_name = sensor_config_params[3];
+            config.sensor_type = sensor_config_params[4];
+            addSensor(config);
+            configureWorld(config.world_name);
+        }
+
+        // Sensors are otherwise discovered from the ignition topic list, including those spawned
+        // after the platform started. The platform loop adds them.
+        double discovery_period = this->get_parameter("sensor_discovery_period").as_double();
+        if (discovery_period > 0.0)
+        {
+            sensor_discovery_ = std::make_unique<SensorDiscovery>(
+                ignition_bridge_->ign_node_ptr_,
+                namespace_.substr(1),
+                std::chrono::milliseconds(static_cast<int64_t>(discovery_period * 1000.0)));
+        }
+
+        // A recording played back instead of the simulator, through the same subscriptions. Its
+        // topics are advertised right away so that discovery finds the recorded sensors.
+        std::string replay_path = this->get_parameter("replay_path").as_string();
+        if (!replay_path.empty())
+        {
+            replay_ = std::make_unique<StreamReplay>(
+                ignition_bridge_->ign_node_ptr_,
+                replay_path,
+                this->get_parameter("replay_speed").as_double(),
+                std::chrono::milliseconds(static_cast<int64_t>(
+                    this->get_parameter("replay_start_delay").as_double() * 1000.0)));
+            RCLCPP_INFO(this->get_logger(), "Replaying ignition messages from %s", replay_path.c_str());
+        }
+
+        return;
+    };
+
+    void IgnitionPlatform::platformLoop()
+    {
+        if (sensor_discovery_)
+        {
+            processDiscoveredSensors();
+        }
+        checkStaticTransforms();
+        // rclcpp has no subscriber matched event here, so the subscriber count is polled
+        if (lazy_subscriptions_)
+        {
+            std::lock_guard<std::mutex> lock(sensors_mutex_);
+            updateSensorDemand();
+        }
+        return;
+    };
+
+    void IgnitionPlatform::processDiscoveredSensors()
+    {
+        configureWorld(sensor_discovery_->getWorldName());
+        for (const auto &config : sensor_discovery_->takeNewSensors())
+        {
+            if (addSensor(config))
+            {
+                RCLCPP_INFO(this->get_logger(), "Sensor discovered: %s (%s)",
+                            config.sensor_name.c_str(), config.sensor_type.c_str());
+            }
+        }
+
+        if (!first_sensor_message_reported_)
+        {
+            for (const auto &sensor_stats : ignition_bridge_->getSensorStats())
+            {
+                if (sensor_stats.second->published.load(std::memory_order_relaxed) > 0)
+                {
+                    RCLCPP_INFO(this->get_logger(), "First sensor message published %.3f s after startup",
+                                std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count());
+                    first_sensor_message_reported_ = true;
+                    break;
+                }
+            }
+        }
+        return;
+    };
+
+    double IgnitionPlatform::timerRate(const std::string &name, double default_rate)
+    {
+        // The period of a timer is the inverse of its rate, so zero, negative and NaN are refused
+        double rate = this->get_parameter(name).as_double();
+        if (!(rate > 0.0))
+        {
+            RCLCPP_ERROR(this->get_logger(), "Invalid %s: %f, it must be positive. Using %.1f Hz",
+                         name.c_str(), rate, default_rate);
+            rate = default_rate;
+        }
+        return rate;
+    };
+
+    bool IgnitionPlatform::addSensor(const SensorConfig &config)
+    {
+        std::lock_guard<std::mutex> lock(sensors_mutex_);
+        if (callbacks_tf_.count(config.sensor_name) || configured_sensors_.count(config.sensor_name))
+        {
+            return false;
+        }
+
+        const std::string &sensor_type = config.sensor_type;
+        const std::string &sensor_name = config.sensor_name;
+        if (sensor_type == "camera")
+        {
+            const rclcpp::QoS camera_qos = sensorQoS(sensor_type, sensor_name);
+            CameraPublishers camera_publishers;
+            camera_publishers.image_pub = this->create_publisher<sensor_msgs::msg::Image>(
+                sensorTopic(sensor_name) + "/image_raw", camera_qos);
+            camera_publishers.camera_info_pub = this->create_publisher<sensor_msgs::msg::CameraInfo>(
+                sensorTopic(sensor_name) + "/camera_info", camera_qos);
+            camera_publishers.frame_id = generateTfName(namespace_, sensor_name + "/camera_link");
+            camera_publishers.bundle = bundleFeed<sensor_msgs::msg::Image>(sensor_name, "/image_raw");
+            CameraPublishers *publishers =
+                &camera_publishers_.insert(std::make_pair(sensor_name, camera_publishers)).first->second;
+
+            ImagePipelineOptions pipeline_options;
+            pipeline_options.encoding = sensorParameter<std::string>(sensor_name + ".encoding", "");
+            pipeline_options.roi = sensorParameter<std::vector<int64_t>>(sensor_name + ".roi", {});
+            pipeline_options.pyramid_levels = sensorParameter<int64_t>(sensor_name + ".pyramid_levels", 0);
+            auto pipeline = std::make_shared<ImagePipeline>(pipeline_options);
+            if (pipeline->enabled())
+            {
+                RCLCPP_INFO(this->get_logger(), "Processing %s frames with %s kernels",
+                            sensor_name.c_str(), image_kernels::instructionSet());
+                publishers->pipeline = pipeline;
+                const char *level_topics[] = {"/image_half", "/image_quarter"};
+                for (size_t i = 0; i < pipeline->levels(); i++)
+                {
+                    publishers->level_pubs.emplace_back(this->create_publisher<sensor_msgs::msg::Image>(
+                        sensorTopic(sensor_name) + level_topics[i], camera_qos));
+                }
+            }
+
+            // Per camera "<sensor_name>.max_rate" and "<sensor_name>.latest_only" override the defaults
+            StreamPolicy policy;
+            policy.max_rate = sensorParameter(sensor_name + ".max_rate",
+                                              this->get_parameter("camera_max_rate").as_double());
+            policy.latest_only = sensorParameter(sensor_name + ".latest_only",
+                                                 this->get_parameter("camera_latest_only").as_bool());
+
+            ignition_bridge_->addSensor(
+                config.world_name,
+                config.model_name,
+                config.sensor_name,
+                config.link_name,
+                config.sensor_type,
+                [this, publishers](sensor_msgs::msg::Image &msg)
+                { cameraCallback(msg, *publishers); },
+                [this, publishers](sensor_msgs::msg::CameraInfo &msg)
+                { cameraInfoCallback(msg, *publishers); },
+                [this](geometry_msgs::msg::TransformStamped &msg, const std::string &name)
+                { cameraTFCallback(msg, name); },
+                policy);
+        }
+        else if (sensor_type == "lidar")
+        {
+            const rclcpp::QoS lidar_qos = sensorQoS(sensor_type, sensor_name);
+            auto *laser_scan_publisher =
+                laser_scan_publishers_.insert(std::make_pair(
+                                                  sensor_name,
+                                                  this->create_publisher<sensor_msgs::msg::LaserScan>(
+                                                      sensorTopic(sensor_name), lidar_qos)))
+                    .first->second.get();
+            auto *point_cloud_publisher =
+                point_cloud_publishers_.insert(std::make_pair(
+                                                   sensor_name,
+                                                   this->create_publisher<sensor_msgs::msg::PointCloud2>(
+                                                       sensorTopic(sensor_name + "/points"), lidar_qos)))
+                    .first->second.get();
+
+            bool points_from_scan = sensorParameter(sensor_name + ".points_from_scan",
+                                                    this->get_parameter("lidar_points_from_scan").as_bool());
+            if (points_from_scan)
             {
-                as2::sensors::Camera camera = as2::sensors::Camera(sensor_config_params[2], this);
-                callbacks_camera_.insert(std::make_pair(sensor_config_params[2],
-                                                        camera));
-
-                ignition_bridge_->addSensor(
-                    sensor_config_params[0],
-                    sensor_config_params[1],
-                    sensor_config_params[2],
-                    sensor_config_params[3],
-                    sensor_config_params[4],
-                    cameraCallback,
-                    cameraInfoCallback,
-                    cameraTFCallback);
+                points_from_scan_.insert(sensor_name);
             }
-            else if (sensor_type == "lidar")
+
+            PointCloudFilterOptions filter_options;
+            filter_options.type = sensorParameter<std::string>(sensor_name + ".filter", "");
+            filter_options.leaf_size = sensorParameter(sensor_name + ".leaf_size", 0.1);
+            filter_options.keep_ratio = sensorParameter(sensor_name + ".keep_ratio", 0.1);
+            if (filter_options.type == "voxel" && !PointCloudFilter::validLeafSize(filter_options.leaf_size))
             {
-                as2::sensors::Sensor<sensor_msgs::msg::LaserScan> laser_scan_sensor(sensor_config_params[2], this);
-                as2::sensors::Sensor<sensor_msgs::msg::PointCloud2> point_cloud_sensor(sensor_config_params[2] + "/points", this);
-
-                callbacks_laser_scan_.insert(std::make_pair(sensor_config_params[2], laser_scan_sensor));
-                callbacks_point_cloud_.insert(std::make_pair(sensor_config_params[2], point_cloud_sensor));
-
-                ignition_bridge_->addSensor(
-                    sensor_config_params[0],
-                    sensor_config_params[1],
-                    sensor_config_params[2],
-                    sensor_config_params[3],
-                    sensor_config_params[4],
-                    laserScanCallback,
-                    pointCloudCallback,
-                    lidarTFCallback);
+                RCLCPP_WARN(this->get_logger(), "Invalid leaf_size for %s: %f, it must be at least %g m. "
+                            "Publishing the cloud unfiltered", sensor_name.c_str(), filter_options.leaf_size,
+                            PointCloudFilter::kMinLeafSize);
+                filter_options.type.clear();
             }
-            else if (sensor_type == "gps")
+            PointCloudFilter *filter = nullptr;
+            auto point_cloud_filter = std::make_shared<PointCloudFilter>(filter_options);
+            if (point_cloud_filter->enabled())
             {
-                as2::sensors::Sensor<sensor_msgs::msg::NavSatFix> gps_sensor(sensor_config_params[2], this);
-                callbacks_gps_.insert(std::make_pair(sensor_config_params[2], gps_sensor));
-
-                ignition_bridge_->addSensor(
-                    sensor_config_params[0],
-                    sensor_config_params[1],
-                    sensor_config_params[2],
-                    sensor_config_params[3],
-                    sensor_config_params[4],
-                    gpsCallback,
-                    gpsTFCallback);
+                filter = point_cloud_filter.get();
+                point_cloud_filters_.insert(std::make_pair(sensor_name + "/points", point_cloud_filter));
             }
-            else if (sensor_type == "imu")
+            else if (!filter_options.type.empty())
+            {
+                RCLCPP_WARN(this->get_logger(), "Invalid point cloud filter for %s: %s",
+                            sensor_name.c_str(), filter_options.type.c_str());
+            }
+
+            std::string frame_id = generateTfName(namespace_, sensor_name);
+            auto laser_scan_bundle = bundleFeed<sensor_msgs::msg::LaserScan>(sensor_name);
+            auto point_cloud_bundle = bundleFeed<sensor_msgs::msg::PointCloud2>(sensor_name + "/points");
+            ignition_bridge_->addSensor(
+                config.world_name,
+                config.model_name,
+                config.sensor_name,
+                config.link_name,
+                config.sensor_type,
+                [this, laser_scan_publisher, frame_id, laser_scan_bundle](sensor_msgs::msg::LaserScan &msg)
+                { laserScanCallback(msg, *laser_scan_publisher, frame_id, laser_scan_bundle); },
+                [this, point_cloud_publisher, filter, frame_id, point_cloud_bundle](sensor_msgs::msg::PointCloud2 &msg)
+                { pointCloudCallback(msg, *point_cloud_publisher, filter, frame_id, point_cloud_bundle); },
+                [this](geometry_msgs::msg::TransformStamped &msg, const std::string &name)
+                { lidarTFCallback(msg, name); },
+                points_from_scan);
+        }
+        else if (sensor_type == "gps")
+        {
+            as2::sensors::Sensor<sensor_msgs::msg::NavSatFix> gps_sensor(sensor_name, this);
+            auto *gps = &callbacks_gps_.insert(std::make_pair(sensor_name, gps_sensor)).first->second;
+
+            auto gps_bundle = bundleFeed<sensor_msgs::msg::NavSatFix>(sensor_name);
+            ignition_bridge_->addSensor<ignition::msgs::NavSat>(
+                config.world_name,
+                config.model_name,
+                config.sensor_name,
+                config.link_name,
+                config.sensor_type,
+                [this, gps, gps_bundle](sensor_msgs::msg::NavSatFix &msg)
+                {
+                    gpsCallback(msg, *gps);
+                    if (gps_bundle)
+                    {
+                        gps_bundle(msg);
+                    }
+                },
+                [this](geometry_msgs::msg::TransformStamped &msg, const std::string &name)
+                { gpsTFCallback(msg, name); });
+        }
+        else if (sensor_type == "imu")
+        {
+            as2::sensors::Sensor<sensor_msgs::msg::Imu> imu_sensor(sensor_name, this);
+            auto *imu = &callbacks_imu_.insert(std::make_pair(sensor_name, imu_sensor)).first->second;
+
+            std::string frame_id = generateTfName(namespace_, sensor_name);
+            auto imu_bundle = bundleFeed<sensor_msgs::msg::Imu>(sensor_name);
+            ignition_bridge_->addSensor<ignition::msgs::IMU>(
+                config.world_name,
+                config.model_name,
+                config.sensor_name,
+                config.link_name,
+                config.sensor_type,
+                [this, imu, frame_id, imu_bundle](sensor_msgs::msg::Imu &msg)
+                {
+                    imuCallback(msg, *imu, frame_id);
+                    if (imu_bundle)
+                    {
+                        imu_bundle(msg);
+                    }
+                },
+                [this](geometry_msgs::msg::TransformStamped &msg, const std::string &name)
+                { imuTFCallback(msg, name); });
+        }
+        else
+        {
+            RCLCPP_WARN(this->get_logger(), "Sensor type not supported: %s", sensor_type.c_str());
+            return false;
+        }
+        callbacks_tf_.insert(std::make_pair(sensor_name, true));
+        configured_sensors_.insert(sensor_name);
+        static_tf_deadline_ = std::chrono::steady_clock::now() + static_tf_timeout_;
+        ignition_bridge_->subscribePoseStatic();
+        updateSensorDemand();
+        return true;
+    };
+
+    void IgnitionPlatform::updateSensorDemand()
+    {
+        // Images and point clouds are only bridged while someone listens on the ROS side, or
+        // while they feed a bundle
+        for (const auto &camera : camera_publishers_)
+        {
+            size_t image_subscribers = camera.second.image_pub->get_subscription_count() +
+                                       bundled_sensors_.count(camera.first);
+            for (const auto &level_pub : camera.second.level_pubs)
             {
-                as2::sensors::Sensor<sensor_msgs::msg::Imu> imu_sensor(sensor_config_params[2], this);
-                callbacks_imu_.insert(std::make_pair(sensor_config_params[2], imu_sensor));
-
-                ignition_bridge_->addSensor(
-                    sensor_config_params[0],
-                    sensor_config_params[1],
-                    sensor_config_params[2],
-                    sensor_config_params[3],
-                    sensor_config_params[4],
-                    imuCallback,
-                    imuTFCallback);
+                image_subscribers += level_pub->get_subscription_count();
             }
-            else
+            size_t info_subscribers = camera.second.camera_info_pub->get_subscription_count();
+            setSensorDemand(camera.first, image_subscribers + info_subscribers > 0);
+            setSensorDemand(camera.first + "/camera_info", info_subscribers > 0);
+        }
+        for (const auto &laser_scan : laser_scan_publishers_)
+        {
+            // The scan also feeds the points when they are projected locally
+            size_t subscribers = laser_scan.second->get_subscription_count() +
+                                 bundled_sensors_.count(laser_scan.first);
+            if (points_from_scan_.count(laser_scan.first))
             {
-                RCLCPP_WARN(this->get_logger(), "Sensor type not supported: %s", sensor_type.c_str());
-                continue;
+                subscribers += point_cloud_publishers_[laser_scan.first]->get_subscription_count() +
+                               bundled_sensors_.count(laser_scan.first + "/points");
             }
-            callbacks_tf_.insert(std::make_pair(sensor_config_params[2], true));
-        }
-
-        if (world_name != "")
-        {
-            imu_ptr_ =
-                std::make_unique<as2::sensors::Sensor<sensor_msgs::msg::Imu>>("imu", this);
-            ignition_bridge_->setImuCallback(imuSensorCallback, world_name);
-            imu_ptr_->setStaticTransform(
-                namespace_ + "/imu",
-                namespace_ + "/base_link",
-                0.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 0.0f, 0.1f);
-
-            air_pressure_ptr_ =
-                std::make_unique<as2::sensors::Sensor<sensor_msgs::msg::FluidPressure>>("air_pressure", this);
-            ignition_bridge_->setAirPressureCallback(airPressureSensorCallback, world_name);
-            air_pressure_ptr_->setStaticTransform(
-                namespace_ + "/magnetometer",
-                namespace_ + "/base_link",
-                0.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 0.0f, 0.1f);
-
-            magnetometer_ptr_ =
-                std::make_unique<as2::sensors::Sensor<sensor_msgs::msg::MagneticField>>("magnetometer", this);
-            ignition_bridge_->setMagnetometerCallback(magnetometerSensorCallback, world_name);
-            magnetometer_ptr_->setStaticTransform(
-                namespace_ + "/air_pressure",
-                namespace_ + "/base_link",
-                0.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 0.0f, 0.1f);
+            setSensorDemand(laser_scan.first, subscribers > 0);
         }
+        for (const auto &point_cloud : point_cloud_publishers_)
+        {
+            size_t subscribers = point_cloud.second->get_subscription_count() +
+                                 bundled_sensors_.count(point_cloud.first + "/points");
+            setSensorDemand(point_cloud.first + "/points", subscribers > 0);
+        }
+        return;
+    };
 
+    void IgnitionPlatform::setSensorDemand(const std::string &name, bool demand)
+    {
+        // A recording has every stream the simulator publishes, whether or not it is observed
+        const bool always_bridged = !lazy_subscriptions_ || recorder_ != nullptr;
+        if (ignition_bridge_->setSensorDemand(name, demand || always_bridged))
+        {
+            RCLCPP_DEBUG(this->get_logger(), "%s ignition subscription for %s",
+                         demand ? "Starting" : "Stopping", name.c_str());
+        }
         return;
     };
 
+    void IgnitionPlatform::configureWorld(const std::string &world_name)
+    {
+        if (world_name == "" || world_configured_)
+        {
+            return;
+        }
+        world_configured_ = true;
+
+        imu_ptr_ =
+            std::make_unique<as2::sensors::Sensor<sensor_msgs::msg::Imu>>("imu", this);
+        auto imu_bundle = bundleFeed<sensor_msgs::msg::Imu>("imu");
+        ignition_bridge_->setImuCallback(
+            [this, imu_bundle](sensor_msgs::msg::Imu &msg)
+            {
+                imuSensorCallback(msg);
+                if (imu_bundle)
+                {
+                    imu_bundle(msg);
+                }
+            },
+            world_name);
+        imu_ptr_->setStaticTransform(
+            namespace_ + "/imu",
+            namespace_ + "/base_link",
+            0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.1f);
+
+        air_pressure_ptr_ =
+            std::make_unique<as2::sensors::Sensor<sensor_msgs::msg::FluidPressure>>("air_pressure", this);
+        ignition_bridge_->setAirPressureCallback(
+            [this](sensor_msgs::msg::FluidPressure &msg)
+            { airPressureSensorCallback(msg); },
+            world_name);
+        air_pressure_ptr_->setStaticTransform(
+            namespace_ + "/magnetometer",
+            namespace_ + "/base_link",
+            0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.1f);
+
+        magnetometer_ptr_ =
+            std::make_unique<as2::sensors::Sensor<sensor_msgs::msg::MagneticField>>("magnetometer", this);
+        ignition_bridge_->setMagnetometerCallback(
+            [this](sensor_msgs::msg::MagneticField &msg)
+            { magnetometerSensorCallback(msg); },
+            world_name);
+        magnetometer_ptr_->setStaticTransform(
+            namespace_ + "/air_pressure",
+            namespace_ + "/base_link",
+            0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.1f);
+    };
+
     bool IgnitionPlatform::ownSendCommand()
     {
+        // At a fixed rate a command is only forwarded on fresh odometry, so the rate follows the
+        // odometry. In event driven mode this is a keep-alive resending the last command.
+        if (!event_driven_commands_ &&
+            control_in_.reference_frame == as2_msgs::msg::ControlMode::LOCAL_ENU_FRAME &&
+            vehicle_state_.sequence() == last_vehicle_state_sequence_)
+        {
+            return false;
+        }
+        return forwardTwist(command_twist_msg_.twist);
+    };
+
+    bool IgnitionPlatform::forwardTwist(const geometry_msgs::msg::Twist &command_twist)
+    {
+        geometry_msgs::msg::Twist twist_msg = command_twist;
         if (control_in_.reference_frame == as2_msgs::msg::ControlMode::LOCAL_ENU_FRAME)
         {
-            if (!odometry_info_received_)
+            VehicleState state;
+            uint64_t state_sequence = vehicle_state_.load(state);
+            if (state_sequence == 0)
             {
                 return false;
             }
-            odometry_info_received_ = false;
+            last_vehicle_state_sequence_ = state_sequence;
 
-            if (command_twist_msg_.twist.angular.z > yaw_rate_limit_)
+            if (twist_msg.angular.z > yaw_rate_limit_)
             {
-                command_twist_msg_.twist.angular.z = yaw_rate_limit_;
+                twist_msg.angular.z = yaw_rate_limit_;
             }
-            else if (command_twist_msg_.twist.angular.z < -yaw_rate_limit_)
+            else if (twist_msg.angular.z < -yaw_rate_limit_)
             {
-                command_twist_msg_.twist.angular.z = -yaw_rate_limit_;
+                twist_msg.angular.z = -yaw_rate_limit_;
             }
 
-            Eigen::Vector3d twist_lineal_enu = Eigen::Vector3d(command_twist_msg_.twist.linear.x,
-                                                               command_twist_msg_.twist.linear.y,
-                                                               command_twist_msg_.twist.linear.z);
+            Eigen::Vector3d twist_lineal_enu = Eigen::Vector3d(twist_msg.linear.x,
+                                                               twist_msg.linear.y,
+                                                               twist_msg.linear.z);
+
+            geometry_msgs::msg::Quaternion self_orientation;
+            self_orientation.x = state.orientation[0];
+            self_orientation.y = state.orientation[1];
+            self_orientation.z = state.orientation[2];
+            self_orientation.w = state.orientation[3];
 
-            Eigen::Vector3d twist_lineal_flu = as2::FrameUtils::convertENUtoFLU(self_orientation_, twist_lineal_enu);
-            command_twist_msg_.twist.linear.x = twist_lineal_flu(0);
-            command_twist_msg_.twist.linear.y = twist_lineal_flu(1);
-            command_twist_msg_.twist.linear.z = twist_lineal_flu(2);
+            Eigen::Vector3d twist_lineal_flu = as2::FrameUtils::convertENUtoFLU(self_orientation, twist_lineal_enu);
+            twist_msg.linear.x = twist_lineal_flu(0);
+            twist_msg.linear.y = twist_lineal_flu(1);
+            twist_msg.linear.z = twist_lineal_flu(2);
 
-            ignition_bridge_->sendTwistMsg(command_twist_msg_.twist);
+            ignition_bridge_->sendTwistMsg(twist_msg);
         }
         else if (control_in_.reference_frame == as2_msgs::msg::ControlMode::BODY_FLU_FRAME)
         {
-            ignition_bridge_->sendTwistMsg(command_twist_msg_.twist);
+            ignition_bridge_->sendTwistMsg(twist_msg);
+        }
+        else
+        {
+            return true;
+        }
+
+        if (command_pending_)
+        {
+            command_pending_ = false;
+            command_latency_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - command_received_time_)
+                                        .count());
         }
         return true;
     };
 
+    void IgnitionPlatform::twistCommandCallback(const geometry_msgs::msg::TwistStamped::SharedPtr msg)
+    {
+        command_received_time_ = std::chrono::steady_clock::now();
+        command_pending_ = true;
+        command_twist_msg_ = *msg;
+        // The base class checks the control mode, arming and offboard state before ownSendCommand
+        this->sendCommand();
+        return;
+    };
+
+    void IgnitionPlatform::reportCommandLatency()
+    {
+        if (command_latency_.count() == 0)
+        {
+            return;
+        }
+        RCLCPP_INFO(this->get_logger(),
+                    "Command to ignition latency over %lu commands: p50 %.3f ms, p99 %.3f ms, max %.3f ms",
+                    command_latency_.count(),
+                    command_latency_.percentile(50.0) * 1e-6,
+                    command_latency_.percentile(99.0) * 1e-6,
+                    command_latency_.max() * 1e-6);
+        command_latency_.reset();
+        return;
+    };
+
+    diagnostic_msgs::msg::KeyValue keyValue(const std::string &key, double value)
+    {
+        diagnostic_msgs::msg::KeyValue key_value;
+        key_value.key = key;
+        key_value.value = std::to_string(value);
+        return key_value;
+    };
+
+    void IgnitionPlatform::publishSensorStats()
+    {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_stats_time_).count();
+        last_stats_time_ = now;
+
+        diagnostic_msgs::msg::DiagnosticArray diagnostics;
+        diagnostics.header.stamp = this->now();
+
+        for (const auto &sensor_stats : ignition_bridge_->getSensorStats())
+        {
+            SensorStats &stats = *sensor_stats.second;
+            StatsSnapshot &last = last_stats_[sensor_stats.first];
+
+            StatsSnapshot current;
+            current.received = stats.received.load(std::memory_order_relaxed);
+            current.published = stats.published.load(std::memory_order_relaxed);
+            current.dropped = stats.dropped.load(std::memory_order_relaxed);
+            current.bytes = stats.bytes.load(std::memory_order_relaxed);
+
+            diagnostic_msgs::msg::DiagnosticStatus status;
+            status.name = std::string(this->get_fully_qualified_name()) + ": " + sensor_stats.first;
+            status.hardware_id = namespace_;
+            status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+            status.message = "OK";
+            if (current.dropped > last.dropped)
+            {
+                status.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+                status.message = "Dropping messages";
+            }
+
+            status.values.emplace_back(keyValue("received", current.received));
+            status.values.emplace_back(keyValue("published", current.published));
+            status.values.emplace_back(keyValue("dropped", current.dropped));
+            if (elapsed > 0.0)
+            {
+                status.values.emplace_back(keyValue("rate_hz", (current.received - last.received) / elapsed));
+                status.values.emplace_back(keyValue("bytes_per_second", (current.bytes - last.bytes) / elapsed));
+            }
+            status.values.emplace_back(keyValue("conversion_p50_us", stats.conversion_time.percentile(50.0) * 1e-3));
+            status.values.emplace_back(keyValue("conversion_p99_us", stats.conversion_time.percentile(99.0) * 1e-3));
+            status.values.emplace_back(keyValue("dispatch_p50_us", stats.dispatch_time.percentile(50.0) * 1e-3));
+            status.values.emplace_back(keyValue("dispatch_p99_us", stats.dispatch_time.percentile(99.0) * 1e-3));
+
+            auto filter = point_cloud_filters_.find(sensor_stats.first);
+            if (filter != point_cloud_filters_.end())
+            {
+                status.values.emplace_back(keyValue("filter_input_points", filter->second->input_points.load(std::memory_order_relaxed)));
+                status.values.emplace_back(keyValue("filter_output_points", filter->second->output_points.load(std::memory_order_relaxed)));
+                status.values.emplace_back(keyValue("filter_p99_us", filter->second->filter_time.percentile(99.0) * 1e-3));
+                filter->second->filter_time.reset();
+            }
+
+            // Percentiles cover the last period only
+            stats.conversion_time.reset();
+            stats.dispatch_time.reset();
+            last = current;
+
+            diagnostics.status.emplace_back(status);
+        }
+
+        diagnostics_pub_->publish(diagnostics);
+        return;
+    };
+
     bool IgnitionPlatform::ownSetArmingState(bool state)
     {
         resetCommandTwistMsg();
@@ -299,12 +958,6 @@ namespace ignition_platform
 
     bool IgnitionPlatform::checkTf(const std::string &sensor_name)
     {
-        if (callbacks_tf_.empty())
-        {
-            ignition_bridge_->unsuscribePoseStatic();
-            return false;
-        }
-
         // Check if sensor is in the tf map
         auto sensor_list = callbacks_tf_.find(sensor_name);
         if (sensor_list == callbacks_tf_.end())
@@ -321,59 +974,134 @@ namespace ignition_platform
         return true;
     }
 
+    void IgnitionPlatform::checkStaticTransforms()
+    {
+        std::lock_guard<std::mutex> lock(sensors_mutex_);
+        if (!callbacks_tf_.empty() && std::chrono::steady_clock::now() > static_tf_deadline_)
+        {
+            // A sensor missing from the model would otherwise keep pose_static alive forever
+            std::string missing;
+            for (const auto &sensor : callbacks_tf_)
+            {
+                missing += (missing.empty() ? "" : ", ") + sensor.first;
+            }
+            RCLCPP_WARN(this->get_logger(), "No static transform received for: %s", missing.c_str());
+            callbacks_tf_.clear();
+        }
+
+        if (callbacks_tf_.empty())
+        {
+            ignition_bridge_->unsuscribePoseStatic();
+        }
+        return;
+    };
+
     void IgnitionPlatform::poseCallback(geometry_msgs::msg::PoseStamped &pose_msg)
     {
-        pose_ptr_->updateData(pose_msg);
+        pose_pub_->publish(pose_msg);
         return;
     };
 
     void IgnitionPlatform::odometryCallback(nav_msgs::msg::Odometry &odom_msg)
     {
-        odom_msg.header.frame_id = generateTfName(namespace_, "odom");
-
-        odometry_raw_estimation_ptr_->updateData(odom_msg);
-
-        self_orientation_ = odom_msg.pose.pose.orientation;
-        odometry_info_received_ = true;
+        odom_msg.header.frame_id = odom_frame_id_;
+
+        odometry_pub_->publish(odom_msg);
+
+        VehicleState state;
+        state.position[0] = odom_msg.pose.pose.position.x;
+        state.position[1] = odom_msg.pose.pose.position.y;
+        state.position[2] = odom_msg.pose.pose.position.z;
+        state.orientation[0] = odom_msg.pose.pose.orientation.x;
+        state.orientation[1] = odom_msg.pose.pose.orientation.y;
+        state.orientation[2] = odom_msg.pose.pose.orientation.z;
+        state.orientation[3] = odom_msg.pose.pose.orientation.w;
+        state.linear_velocity[0] = odom_msg.twist.twist.linear.x;
+        state.linear_velocity[1] = odom_msg.twist.twist.linear.y;
+        state.linear_velocity[2] = odom_msg.twist.twist.linear.z;
+        state.angular_velocity[0] = odom_msg.twist.twist.angular.x;
+        state.angular_velocity[1] = odom_msg.twist.twist.angular.y;
+        state.angular_velocity[2] = odom_msg.twist.twist.angular.z;
+        state.stamp_sec = odom_msg.header.stamp.sec;
+        state.stamp_nanosec = odom_msg.header.stamp.nanosec;
+        vehicle_state_.store(state);
         return;
     };
 
     void IgnitionPlatform::imuSensorCallback(sensor_msgs::msg::Imu &imu_msg)
     {
-        imu_msg.header.frame_id = generateTfName(namespace_, "imu");
+        imu_msg.header.frame_id = imu_frame_id_;
         imu_ptr_->updateData(imu_msg);
         return;
     };
 
     void IgnitionPlatform::airPressureSensorCallback(sensor_msgs::msg::FluidPressure &air_pressure_msg)
     {
-        air_pressure_msg.header.frame_id = generateTfName(namespace_, "air_pressure");
+        air_pressure_msg.header.frame_id = air_pressure_frame_id_;
         air_pressure_ptr_->updateData(air_pressure_msg);
         return;
     };
 
     void IgnitionPlatform::magnetometerSensorCallback(sensor_msgs::msg::MagneticField &magnetometer_msg)
     {
-        magnetometer_msg.header.frame_id = generateTfName(namespace_, "magnetometer");
+        magnetometer_msg.header.frame_id = magnetometer_frame_id_;
         magnetometer_ptr_->updateData(magnetometer_msg);
         return;
     };
 
     void IgnitionPlatform::cameraCallback(
         sensor_msgs::msg::Image &image_msg,
-        const std::string &sensor_name)
+        CameraPublishers &publishers)
     {
-        image_msg.header.frame_id = generateTfName(namespace_, sensor_name + "/camera_link");
-        (callbacks_camera_.find(sensor_name)->second).updateData(image_msg);
+        image_msg.header.frame_id = publishers.frame_id;
+        if (publishers.bundle)
+        {
+            publishers.bundle(image_msg);
+        }
+        {
+            std::lock_guard<std::mutex> lock(*publishers.camera_info_mutex);
+            if (publishers.camera_info_received)
+            {
+                publishers.camera_info.header = image_msg.header;
+                publishers.camera_info_pub->publish(publishers.camera_info);
+            }
+        }
+
+        sensor_msgs::msg::Image *processed =
+            publishers.pipeline ? publishers.pipeline->process(image_msg) : nullptr;
+        if (!processed)
+        {
+            // Frames the pipeline cannot handle are published as they are, without levels
+            if (publishers.pipeline)
+            {
+                RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                                     "Camera %s: %s frames are not processed, publishing them unchanged",
+                                     publishers.frame_id.c_str(), image_msg.encoding.c_str());
+            }
+            publishMessage(*publishers.image_pub, image_msg);
+            return;
+        }
+
+        publishMessage(*publishers.image_pub, *processed);
+        for (size_t i = 0; i < publishers.level_pubs.size(); i++)
+        {
+            publishers.level_pubs[i]->publish(publishers.pipeline->level(i));
+        }
         return;
     };
 
     void IgnitionPlatform::cameraInfoCallback(
         sensor_msgs::msg::CameraInfo &info_msg,
-        const std::string &sensor_name)
+        CameraPublishers &publishers)
     {
-        info_msg.header.frame_id = generateTfName(namespace_, sensor_name + "/camera_link");
-        (callbacks_camera_.find(sensor_name)->second).setParameters(info_msg);
+        info_msg.header.frame_id = publishers.frame_id;
+        if (publishers.pipeline)
+        {
+            publishers.pipeline->adjustCameraInfo(info_msg);
+        }
+        std::lock_guard<std::mutex> lock(*publishers.camera_info_mutex);
+        publishers.camera_info = info_msg;
+        publishers.camera_info_received = true;
         return;
     };
 
@@ -381,47 +1109,82 @@ namespace ignition_platform
         geometry_msgs::msg::TransformStamped &msg,
         const std::string &sensor_name)
     {
+        std::lock_guard<std::mutex> lock(sensors_mutex_);
         if (!checkTf(sensor_name))
         {
             return;
         }
 
-        auto sensor = callbacks_camera_.find(sensor_name);
-        if (sensor == callbacks_camera_.end())
-        {
-            return;
-        }
-
-        sensor->second.setStaticTransform(
-            msg.child_frame_id,
-            msg.header.frame_id,
-            msg.transform.translation.x,
-            msg.transform.translation.y,
-            msg.transform.translation.z,
-            msg.transform.rotation.x,
-            msg.transform.rotation.y,
-            msg.transform.rotation.z,
-            msg.transform.rotation.w);
+        // Images are stamped in the optical frame of the camera, z forward and x right, under the
+        // frame of the sensor
+        geometry_msgs::msg::TransformStamped optical;
+        optical.header.frame_id = msg.child_frame_id;
+        optical.child_frame_id = msg.child_frame_id + "/camera_link";
+        optical.transform.rotation.x = -0.5;
+        optical.transform.rotation.y = 0.5;
+        optical.transform.rotation.z = -0.5;
+        optical.transform.rotation.w = 0.5;
+        sendStaticTransforms({msg, optical});
 
         callbacks_tf_.erase(sensor_name);
         return;
     };
 
+    void IgnitionPlatform::sendStaticTransforms(std::vector<geometry_msgs::msg::TransformStamped> transforms)
+    {
+        // Frame names resolved the way as2 sensors resolve theirs
+        const rclcpp::Time now = this->get_clock()->now();
+        for (auto &transform : transforms)
+        {
+            transform.header.stamp = now;
+            transform.header.frame_id = generateTfName(namespace_, transform.header.frame_id);
+            transform.child_frame_id = generateTfName(namespace_, transform.child_frame_id);
+        }
+        static_tf_broadcaster_->sendTransform(transforms);
+        return;
+    };
+
     void IgnitionPlatform::laserScanCallback(
         sensor_msgs::msg::LaserScan &laser_scan_msg,
-        const std::string &sensor_name)
+        rclcpp::Publisher<sensor_msgs::msg::LaserScan> &publisher,
+        const std::string &frame_id,
+        const std::function<void(const sensor_msgs::msg::LaserScan &)> &bundle)
     {
-        laser_scan_msg.header.frame_id = generateTfName(namespace_, sensor_name);
-        (callbacks_laser_scan_.find(sensor_name)->second).updateData(laser_scan_msg);
+        laser_scan_msg.header.frame_id = frame_id;
+        if (bundle)
+        {
+            bundle(laser_scan_msg);
+        }
+        publishMessage(publisher, laser_scan_msg);
         return;
     };
 
     void IgnitionPlatform::pointCloudCallback(
         sensor_msgs::msg::PointCloud2 &point_cloud_msg,
-        const std::string &sensor_name)
+        rclcpp::Publisher<sensor_msgs::msg::PointCloud2> &publisher,
+        PointCloudFilter *filter,
+        const std::string &frame_id,
+        const std::function<void(const sensor_msgs::msg::PointCloud2 &)> &bundle)
     {
-        point_cloud_msg.header.frame_id = generateTfName(namespace_, sensor_name);
-        (callbacks_point_cloud_.find(sensor_name)->second).updateData(point_cloud_msg);
+        point_cloud_msg.header.frame_id = frame_id;
+        // A bundle gets the very cloud published on the sensor topic
+        if (filter)
+        {
+            const sensor_msgs::msg::PointCloud2 &filtered = filter->apply(point_cloud_msg);
+            if (bundle)
+            {
+                bundle(filtered);
+            }
+            publisher.publish(filtered);
+        }
+        else
+        {
+            if (bundle)
+            {
+                bundle(point_cloud_msg);
+            }
+            publishMessage(publisher, point_cloud_msg);
+        }
         return;
     };
 
@@ -429,39 +1192,15 @@ namespace ignition_platform
         geometry_msgs::msg::TransformStamped &msg,
         const std::string &sensor_name)
     {
+        std::lock_guard<std::mutex> lock(sensors_mutex_);
         if (!checkTf(sensor_name))
         {
             return;
         }
 
-        auto sensor_laser = callbacks_laser_scan_.find(sensor_name);
-        auto sensor_cloud = callbacks_point_cloud_.find(sensor_name);
-        if (sensor_laser == callbacks_laser_scan_.end() || sensor_cloud == callbacks_point_cloud_.end())
-        {
-            return;
-        }
-
-        sensor_laser->second.setStaticTransform(
-            msg.child_frame_id,
-            msg.header.frame_id,
-            msg.transform.translation.x,
-            msg.transform.translation.y,
-            msg.transform.translation.z,
-            msg.transform.rotation.x,
-            msg.transform.rotation.y,
-            msg.transform.rotation.z,
-            msg.transform.rotation.w);
-
-        sensor_cloud->second.setStaticTransform(
-            msg.child_frame_id + "_cloud",
-            msg.header.frame_id,
-            msg.transform.translation.x,
-            msg.transform.translation.y,
-            msg.transform.translation.z,
-            msg.transform.rotation.x,
-            msg.transform.rotation.y,
-            msg.transform.rotation.z,
-            msg.transform.rotation.w);
+        geometry_msgs::msg::TransformStamped cloud = msg;
+        cloud.child_frame_id = msg.child_frame_id + "_cloud";
+        sendStaticTransforms({msg, cloud});
 
         callbacks_tf_.erase(sensor_name);
         return;
@@ -469,10 +1208,10 @@ namespace ignition_platform
 
     void IgnitionPlatform::gpsCallback(
         sensor_msgs::msg::NavSatFix &gps_msg,
-        const std::string &sensor_name)
+        as2::sensors::Sensor<sensor_msgs::msg::NavSatFix> &sensor)
     {
         gps_msg.header.frame_id = "wgs86";
-        (callbacks_gps_.find(sensor_name)->second).updateData(gps_msg);
+        sensor.updateData(gps_msg);
         return;
     };
 
@@ -480,6 +1219,7 @@ namespace ignition_platform
         geometry_msgs::msg::TransformStamped &msg,
         const std::string &sensor_name)
     {
+        std::lock_guard<std::mutex> lock(sensors_mutex_);
         if (!checkTf(sensor_name))
         {
             return;
@@ -508,10 +1248,11 @@ namespace ignition_platform
 
     void IgnitionPlatform::imuCallback(
         sensor_msgs::msg::Imu &imu_msg,
-        const std::string &sensor_name)
+        as2::sensors::Sensor<sensor_msgs::msg::Imu> &sensor,
+        const std::string &frame_id)
     {
-        imu_msg.header.frame_id = generateTfName(namespace_, sensor_name);
-        (callbacks_imu_.find(sensor_name)->second).updateData(imu_msg);
+        imu_msg.header.frame_id = frame_id;
+        sensor.updateData(imu_msg);
         return;
     };
     
@@ -519,6 +1260,7 @@ namespace ignition_platform
         geometry_msgs::msg::TransformStamped &msg,
         const std::string &sensor_name)
     {
+        std::lock_guard<std::mutex> lock(sensors_mutex_);
         if (!checkTf(sensor_name))
         {
             return;
@@ -545,3 +1287,5 @@ namespace ignition_platform
         return;
     };
 }
+
+RCLCPP_COMPONENTS_REGISTER_NODE(ignition_platform::IgnitionPlatform)
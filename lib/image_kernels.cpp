@@ -0,0 +1,233 @@
+/*!*******************************************************************************************
+ *  \file       image_kernels.cpp
+ *  \brief      Vectorized pixel format conversion and downscaling kernels
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "image_kernels.hpp"
+
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define IMAGE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace ignition_platform {
+namespace image_kernels {
+
+static void swapRedBlueScalar(const uint8_t *src, uint8_t *dst, size_t pixels) {
+  for (size_t i = 0; i < pixels; i++) {
+    const uint8_t red = src[3 * i];
+    dst[3 * i + 1] = src[3 * i + 1];
+    dst[3 * i] = src[3 * i + 2];
+    dst[3 * i + 2] = red;
+  }
+  return;
+};
+
+static void rgbToMonoScalar(const uint8_t *src, uint8_t *dst, size_t pixels) {
+  for (size_t i = 0; i < pixels; i++) {
+    dst[i] = static_cast<uint8_t>((77 * src[3 * i] + 150 * src[3 * i + 1] + 29 * src[3 * i + 2] + 128) >> 8);
+  }
+  return;
+};
+
+// Vertical pass of the box filter over a whole row, the horizontal pass is scalar
+static void averageRowsScalar(const uint8_t *top, const uint8_t *bottom, uint8_t *dst, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) {
+    dst[i] = static_cast<uint8_t>((top[i] + bottom[i] + 1) >> 1);
+  }
+  return;
+};
+
+#ifdef IMAGE_KERNELS_X86
+// Five pixels per 16 byte register, the 16th byte belongs to the next pixel and is rewritten by
+// the following iteration
+__attribute__((target("ssse3"))) static void swapRedBlueSsse3(const uint8_t *src, uint8_t *dst,
+                                                               size_t pixels) {
+  const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+  size_t i = 0;
+  for (; 3 * i + 16 <= 3 * pixels; i += 5) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 3 * i), _mm_shuffle_epi8(v, mask));
+  }
+  swapRedBlueScalar(src + 3 * i, dst + 3 * i, pixels - i);
+  return;
+};
+
+__attribute__((target("avx2"))) static void swapRedBlueAvx2(const uint8_t *src, uint8_t *dst,
+                                                             size_t pixels) {
+  const __m256i mask = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15,
+                                        2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+  size_t i = 0;
+  for (; 3 * i + 31 <= 3 * pixels; i += 10) {
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * i))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * i + 15)), 1);
+    v = _mm256_shuffle_epi8(v, mask);
+    // Low half first, the high half overwrites its trailing byte
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 3 * i), _mm256_castsi256_si128(v));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 3 * i + 15), _mm256_extracti128_si256(v, 1));
+  }
+  swapRedBlueSsse3(src + 3 * i, dst + 3 * i, pixels - i);
+  return;
+};
+
+// Eight pixels span 24 bytes, loaded as two overlapping registers at offsets 0 and 8. Each
+// channel is gathered into 16 bit lanes from both and the weighted sum fits in 16 bits.
+#define IMAGE_KERNELS_CHANNEL_MASKS(C)                                                           \
+  const __m128i lo_##C = _mm_setr_epi8(C, -1, 3 + C, -1, 6 + C, -1, 9 + C, -1, 12 + C, -1,       \
+                                       C == 0 ? 15 : -1, -1, -1, -1, -1, -1);                    \
+  const __m128i hi_##C = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,                   \
+                                       C == 0 ? -1 : 7 + C, -1, 10 + C, -1, 13 + C, -1);
+
+__attribute__((target("ssse3"))) static inline __m128i lumaSsse3(__m128i lo, __m128i hi) {
+  IMAGE_KERNELS_CHANNEL_MASKS(0)
+  IMAGE_KERNELS_CHANNEL_MASKS(1)
+  IMAGE_KERNELS_CHANNEL_MASKS(2)
+  const __m128i red = _mm_or_si128(_mm_shuffle_epi8(lo, lo_0), _mm_shuffle_epi8(hi, hi_0));
+  const __m128i green = _mm_or_si128(_mm_shuffle_epi8(lo, lo_1), _mm_shuffle_epi8(hi, hi_1));
+  const __m128i blue = _mm_or_si128(_mm_shuffle_epi8(lo, lo_2), _mm_shuffle_epi8(hi, hi_2));
+  __m128i sum = _mm_mullo_epi16(red, _mm_set1_epi16(77));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(green, _mm_set1_epi16(150)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(blue, _mm_set1_epi16(29)));
+  sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+  return _mm_srli_epi16(sum, 8);
+};
+
+__attribute__((target("ssse3"))) static void rgbToMonoSsse3(const uint8_t *src, uint8_t *dst,
+                                                             size_t pixels) {
+  size_t i = 0;
+  for (; i + 8 <= pixels; i += 8) {
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * i));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * i + 8));
+    const __m128i luma = lumaSsse3(lo, hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(luma, luma));
+  }
+  rgbToMonoScalar(src + 3 * i, dst + i, pixels - i);
+  return;
+};
+
+__attribute__((target("sse2"))) static void averageRowsSse2(const uint8_t *top, const uint8_t *bottom,
+                                                            uint8_t *dst, size_t bytes) {
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top + i));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_avg_epu8(a, b));
+  }
+  averageRowsScalar(top + i, bottom + i, dst + i, bytes - i);
+  return;
+};
+
+__attribute__((target("avx2"))) static void averageRowsAvx2(const uint8_t *top, const uint8_t *bottom,
+                                                            uint8_t *dst, size_t bytes) {
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(top + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bottom + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_avg_epu8(a, b));
+  }
+  averageRowsSse2(top + i, bottom + i, dst + i, bytes - i);
+  return;
+};
+#endif
+
+struct Kernels {
+  void (*swap_red_blue)(const uint8_t *, uint8_t *, size_t) = swapRedBlueScalar;
+  void (*rgb_to_mono)(const uint8_t *, uint8_t *, size_t) = rgbToMonoScalar;
+  void (*average_rows)(const uint8_t *, const uint8_t *, uint8_t *, size_t) = averageRowsScalar;
+  const char *instruction_set = "scalar";
+};
+
+static Kernels selectKernels() {
+  Kernels kernels;
+#ifdef IMAGE_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    kernels.average_rows = averageRowsSse2;
+    kernels.instruction_set = "sse2";
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    kernels.swap_red_blue = swapRedBlueSsse3;
+    kernels.rgb_to_mono = rgbToMonoSsse3;
+    kernels.instruction_set = "ssse3";
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.swap_red_blue = swapRedBlueAvx2;
+    kernels.average_rows = averageRowsAvx2;
+    kernels.instruction_set = "avx2";
+  }
+#endif
+  return kernels;
+};
+
+static const Kernels &kernels() {
+  static const Kernels selected = selectKernels();
+  return selected;
+};
+
+void swapRedBlue(const uint8_t *src, uint8_t *dst, size_t pixels) {
+  kernels().swap_red_blue(src, dst, pixels);
+  return;
+};
+
+void rgbToMono(const uint8_t *src, uint8_t *dst, size_t pixels) {
+  kernels().rgb_to_mono(src, dst, pixels);
+  return;
+};
+
+void downscale2x(const uint8_t *src, size_t src_step, uint8_t *dst, size_t dst_step,
+                 size_t width, size_t height, size_t channels) {
+  const size_t row_bytes = width * channels;
+  thread_local std::vector<uint8_t> rows;
+  rows.resize(row_bytes);
+
+  for (size_t y = 0; y + 1 < height; y += 2) {
+    kernels().average_rows(src + y * src_step, src + (y + 1) * src_step, rows.data(), row_bytes);
+    uint8_t *out = dst + (y / 2) * dst_step;
+    for (size_t x = 0; x + 1 < width; x += 2) {
+      for (size_t c = 0; c < channels; c++) {
+        out[(x / 2) * channels + c] =
+            static_cast<uint8_t>((rows[x * channels + c] + rows[(x + 1) * channels + c] + 1) >> 1);
+      }
+    }
+  }
+  return;
+};
+
+const char *instructionSet() { return kernels().instruction_set; };
+
+}  // namespace image_kernels
+}  // namespace ignition_platform
@@ -0,0 +1,136 @@
+/*!*******************************************************************************************
+ *  \file       image_pipeline.cpp
+ *  \brief      Camera frame crop, conversion and pyramid stage
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "image_pipeline.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sensor_msgs/image_encodings.hpp>
+
+#include "image_kernels.hpp"
+
+namespace ignition_platform {
+ImagePipeline::ImagePipeline(const ImagePipelineOptions &options)
+    : options_(options), levels_(std::max<int64_t>(0, std::min<int64_t>(options.pyramid_levels, 2))) {
+  if (options_.roi.size() != 4) {
+    options_.roi.clear();
+  }
+};
+
+bool ImagePipeline::enabled() const {
+  return !options_.encoding.empty() || !options_.roi.empty() || !levels_.empty();
+};
+
+sensor_msgs::msg::Image *ImagePipeline::process(sensor_msgs::msg::Image &input) {
+  namespace encodings = sensor_msgs::image_encodings;
+  const bool known_encoding = encodings::isColor(input.encoding) || encodings::isMono(input.encoding);
+  if (!known_encoding || encodings::bitDepth(input.encoding) != 8) {
+    return nullptr;
+  }
+  const size_t channels = encodings::numChannels(input.encoding);
+
+  size_t x = 0, y = 0, width = input.width, height = input.height;
+  if (!options_.roi.empty()) {
+    x = std::min<size_t>(std::max<int64_t>(options_.roi[0], 0), input.width);
+    y = std::min<size_t>(std::max<int64_t>(options_.roi[1], 0), input.height);
+    width = std::min<size_t>(std::max<int64_t>(options_.roi[2], 0), input.width - x);
+    height = std::min<size_t>(std::max<int64_t>(options_.roi[3], 0), input.height - y);
+  }
+
+  // Conversions are only done from the rgb8 frames rendered by the simulator
+  const bool to_mono = options_.encoding == encodings::MONO8 && input.encoding == encodings::RGB8;
+  const bool to_bgr = options_.encoding == encodings::BGR8 && input.encoding == encodings::RGB8;
+  const bool crop = width != input.width || height != input.height;
+
+  sensor_msgs::msg::Image *result = &input;
+  size_t out_channels = channels;
+  if (to_mono || to_bgr || crop) {
+    out_channels = to_mono ? 1 : channels;
+    output_.header = input.header;
+    output_.height = height;
+    output_.width = width;
+    output_.encoding = to_mono ? encodings::MONO8 : (to_bgr ? encodings::BGR8 : input.encoding);
+    output_.is_bigendian = input.is_bigendian;
+    output_.step = width * out_channels;
+    output_.data.resize(output_.step * height);
+
+    for (size_t row = 0; row < height; row++) {
+      const uint8_t *src = input.data.data() + (y + row) * input.step + x * channels;
+      uint8_t *dst = output_.data.data() + row * output_.step;
+      if (to_mono) {
+        image_kernels::rgbToMono(src, dst, width);
+      } else if (to_bgr) {
+        image_kernels::swapRedBlue(src, dst, width);
+      } else {
+        std::memcpy(dst, src, width * channels);
+      }
+    }
+    result = &output_;
+  }
+
+  // Each level halves the previous one
+  const sensor_msgs::msg::Image *previous = result;
+  for (auto &level : levels_) {
+    level.header = previous->header;
+    level.height = previous->height / 2;
+    level.width = previous->width / 2;
+    level.encoding = previous->encoding;
+    level.is_bigendian = previous->is_bigendian;
+    level.step = level.width * out_channels;
+    level.data.resize(level.step * level.height);
+    image_kernels::downscale2x(previous->data.data(), previous->step, level.data.data(), level.step,
+                               previous->width, previous->height, out_channels);
+    previous = &level;
+  }
+  return result;
+};
+
+void ImagePipeline::adjustCameraInfo(sensor_msgs::msg::CameraInfo &info) const {
+  if (options_.roi.empty()) {
+    return;
+  }
+  const double x = static_cast<double>(std::min<int64_t>(std::max<int64_t>(options_.roi[0], 0), info.width));
+  const double y = static_cast<double>(std::min<int64_t>(std::max<int64_t>(options_.roi[1], 0), info.height));
+  info.width = std::min<int64_t>(std::max<int64_t>(options_.roi[2], 0), info.width - static_cast<int64_t>(x));
+  info.height = std::min<int64_t>(std::max<int64_t>(options_.roi[3], 0), info.height - static_cast<int64_t>(y));
+  info.k[2] -= x;
+  info.k[5] -= y;
+  info.p[2] -= x;
+  info.p[6] -= y;
+  return;
+};
+}  // namespace ignition_platform
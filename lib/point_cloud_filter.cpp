@@ -0,0 +1,232 @@
+/*!*******************************************************************************************
+ *  \file       point_cloud_filter.cpp
+ *  \brief      Voxel grid and random downsampling of lidar point clouds
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "point_cloud_filter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace ignition_platform {
+static bool findFloatField(const sensor_msgs::msg::PointCloud2 &cloud, const std::string &name,
+                           uint32_t &offset) {
+  for (const auto &field : cloud.fields) {
+    if (field.name == name && field.datatype == sensor_msgs::msg::PointField::FLOAT32 &&
+        field.offset + sizeof(float) <= cloud.point_step) {
+      offset = field.offset;
+      return true;
+    }
+  }
+  return false;
+};
+
+static inline float readFloat(const uint8_t *point, uint32_t offset) {
+  float value;
+  std::memcpy(&value, point + offset, sizeof(float));
+  return value;
+};
+
+static inline void writeFloat(uint8_t *point, uint32_t offset, float value) {
+  std::memcpy(point + offset, &value, sizeof(float));
+  return;
+};
+
+// 21 bits per axis. Cells 2^20 or more leaves away would alias others, so they are rejected,
+// which also keeps the casts to integer in range.
+static inline bool voxelKey(float x, float y, float z, float inverse_leaf_size, uint64_t &key) {
+  constexpr float max_cell = 1048576.0f;
+  const float cx = std::floor(x * inverse_leaf_size);
+  const float cy = std::floor(y * inverse_leaf_size);
+  const float cz = std::floor(z * inverse_leaf_size);
+  if (!(std::fabs(cx) < max_cell && std::fabs(cy) < max_cell && std::fabs(cz) < max_cell)) {
+    return false;
+  }
+  const uint64_t mask = (1ULL << 21) - 1;
+  const uint64_t ix = static_cast<uint64_t>(static_cast<int64_t>(cx)) & mask;
+  const uint64_t iy = static_cast<uint64_t>(static_cast<int64_t>(cy)) & mask;
+  const uint64_t iz = static_cast<uint64_t>(static_cast<int64_t>(cz)) & mask;
+  key = (ix << 42) | (iy << 21) | iz;
+  return true;
+};
+
+bool PointCloudFilter::validLeafSize(double leaf_size) {
+  return std::isfinite(leaf_size) && leaf_size >= kMinLeafSize;
+};
+
+PointCloudFilter::PointCloudFilter(const PointCloudFilterOptions &options) {
+  if (options.type == "voxel" && validLeafSize(options.leaf_size)) {
+    type_ = Type::VOXEL;
+  } else if (options.type == "random" && options.keep_ratio > 0.0 && options.keep_ratio < 1.0) {
+    type_ = Type::RANDOM;
+  }
+  inverse_leaf_size_ = validLeafSize(options.leaf_size) ? static_cast<float>(1.0 / options.leaf_size) : 0.0f;
+  keep_threshold_ = static_cast<uint64_t>(options.keep_ratio * 18446744073709551615.0);
+};
+
+const sensor_msgs::msg::PointCloud2 &PointCloudFilter::apply(
+    const sensor_msgs::msg::PointCloud2 &input) {
+  uint32_t x_offset, y_offset, z_offset;
+  if (type_ == Type::NONE || input.point_step == 0 || input.is_bigendian ||
+      !findFloatField(input, "x", x_offset) || !findFloatField(input, "y", y_offset) ||
+      !findFloatField(input, "z", z_offset)) {
+    return input;
+  }
+  auto start = std::chrono::steady_clock::now();
+
+  const size_t points = std::min<size_t>(static_cast<size_t>(input.width) * input.height,
+                                         input.data.size() / input.point_step);
+  output_.header = input.header;
+  output_.fields = input.fields;
+  output_.is_bigendian = input.is_bigendian;
+  output_.point_step = input.point_step;
+  // Kept points are appended, so the buffer is not zero filled
+  output_.data.clear();
+  output_.data.reserve(points * input.point_step);
+
+  size_t kept = type_ == Type::VOXEL ? voxelGrid(input, points, x_offset, y_offset, z_offset)
+                                     : randomSubsample(input, points, x_offset, y_offset, z_offset);
+
+  output_.height = 1;
+  output_.width = kept;
+  output_.row_step = kept * input.point_step;
+  output_.is_dense = true;
+
+  input_points.store(points, std::memory_order_relaxed);
+  output_points.store(kept, std::memory_order_relaxed);
+  filter_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+  return output_;
+};
+
+size_t PointCloudFilter::voxelGrid(const sensor_msgs::msg::PointCloud2 &input, size_t points,
+                                   uint32_t x_offset, uint32_t y_offset, uint32_t z_offset) {
+  // At most half full, so probe sequences stay short
+  size_t capacity = 1024;
+  while (capacity < 2 * points) {
+    capacity *= 2;
+  }
+  if (slots_.size() < capacity) {
+    slots_.assign(capacity, Slot{0, 0, 0});
+    generation_ = 0;
+  }
+  if (++generation_ == 0) {
+    std::fill(slots_.begin(), slots_.end(), Slot{0, 0, 0});
+    generation_ = 1;
+  }
+  const size_t mask = slots_.size() - 1;
+  const int shift = 64 - __builtin_ctzll(slots_.size());
+  if (sums_.size() < 4 * points) {
+    sums_.resize(4 * points);
+  }
+
+  const uint32_t step = input.point_step;
+  size_t kept = 0;
+  for (size_t i = 0; i < points; i++) {
+    const uint8_t *point = input.data.data() + i * step;
+    const float x = readFloat(point, x_offset);
+    const float y = readFloat(point, y_offset);
+    const float z = readFloat(point, z_offset);
+    if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) {
+      continue;
+    }
+
+    uint64_t key;
+    if (!voxelKey(x, y, z, inverse_leaf_size_, key)) {
+      continue;
+    }
+    size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> shift);
+    while (true) {
+      Slot &entry = slots_[slot];
+      if (entry.generation != generation_) {
+        entry.key = key;
+        entry.generation = generation_;
+        entry.index = static_cast<uint32_t>(kept);
+        output_.data.insert(output_.data.end(), point, point + step);
+        float *sum = &sums_[4 * kept];
+        sum[0] = x;
+        sum[1] = y;
+        sum[2] = z;
+        sum[3] = 1.0f;
+        kept++;
+        break;
+      }
+      if (entry.key == key) {
+        float *sum = &sums_[4 * entry.index];
+        sum[0] += x;
+        sum[1] += y;
+        sum[2] += z;
+        sum[3] += 1.0f;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+  }
+
+  for (size_t i = 0; i < kept; i++) {
+    const float *sum = &sums_[4 * i];
+    uint8_t *point = output_.data.data() + i * step;
+    writeFloat(point, x_offset, sum[0] / sum[3]);
+    writeFloat(point, y_offset, sum[1] / sum[3]);
+    writeFloat(point, z_offset, sum[2] / sum[3]);
+  }
+  return kept;
+};
+
+size_t PointCloudFilter::randomSubsample(const sensor_msgs::msg::PointCloud2 &input, size_t points,
+                                         uint32_t x_offset, uint32_t y_offset, uint32_t z_offset) {
+  const uint32_t step = input.point_step;
+  size_t kept = 0;
+  for (size_t i = 0; i < points; i++) {
+    // xorshift64
+    random_state_ ^= random_state_ << 13;
+    random_state_ ^= random_state_ >> 7;
+    random_state_ ^= random_state_ << 17;
+    if (random_state_ > keep_threshold_) {
+      continue;
+    }
+    const uint8_t *point = input.data.data() + i * step;
+    if (!std::isfinite(readFloat(point, x_offset)) || !std::isfinite(readFloat(point, y_offset)) ||
+        !std::isfinite(readFloat(point, z_offset))) {
+      continue;
+    }
+    output_.data.insert(output_.data.end(), point, point + step);
+    kept++;
+  }
+  return kept;
+};
+}  // namespace ignition_platform
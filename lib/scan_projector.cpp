@@ -0,0 +1,179 @@
+/*!*******************************************************************************************
+ *  \file       scan_projector.cpp
+ *  \brief      Lidar point cloud projection from laser scans
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "scan_projector.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace ignition_platform {
+void ScanProjector::updateDirections(const ignition::msgs::LaserScan &scan) {
+  const uint32_t count = scan.count();
+  // Planar lidars have no vertical rays
+  const uint32_t vertical_count = std::max<uint32_t>(scan.vertical_count(), 1);
+  if (count == count_ && vertical_count == vertical_count_ && scan.angle_min() == angle_min_ &&
+      scan.angle_step() == angle_step_ && scan.vertical_angle_min() == vertical_angle_min_ &&
+      scan.vertical_angle_step() == vertical_angle_step_) {
+    return;
+  }
+  angle_min_ = scan.angle_min();
+  angle_step_ = scan.angle_step();
+  count_ = count;
+  vertical_angle_min_ = scan.vertical_angle_min();
+  vertical_angle_step_ = scan.vertical_angle_step();
+  vertical_count_ = vertical_count;
+
+  const size_t rays = static_cast<size_t>(count) * vertical_count;
+  direction_x_.resize(rays);
+  direction_y_.resize(rays);
+  direction_z_.resize(rays);
+  for (uint32_t v = 0; v < vertical_count; v++) {
+    const double vertical_angle = scan.vertical_count() > 1 ? vertical_angle_min_ + v * vertical_angle_step_ : 0.0;
+    for (uint32_t h = 0; h < count; h++) {
+      const double angle = angle_min_ + h * angle_step_;
+      const size_t i = static_cast<size_t>(v) * count + h;
+      direction_x_[i] = static_cast<float>(std::cos(vertical_angle) * std::cos(angle));
+      direction_y_[i] = static_cast<float>(std::cos(vertical_angle) * std::sin(angle));
+      direction_z_[i] = static_cast<float>(std::sin(vertical_angle));
+    }
+  }
+  return;
+};
+
+// Layout of the clouds of the gpu_lidar sensor
+static constexpr uint32_t kPointStep = 32;
+static constexpr uint32_t kIntensityOffset = 16;
+static constexpr uint32_t kRingOffset = 20;
+
+static inline void writePoint(uint8_t *point, float x, float y, float z, float intensity,
+                              uint32_t ring) {
+  const float xyz[4] = {x, y, z, 0.0f};
+  std::memcpy(point, xyz, sizeof(xyz));
+  std::memcpy(point + kIntensityOffset, &intensity, sizeof(float));
+  // The uint16 ring and its two bytes of padding, little endian
+  std::memcpy(point + kRingOffset, &ring, sizeof(uint32_t));
+  std::memset(point + kRingOffset + sizeof(uint32_t), 0, kPointStep - kRingOffset - sizeof(uint32_t));
+  return;
+};
+
+void ScanProjector::project(const ignition::msgs::LaserScan &scan,
+                            sensor_msgs::msg::PointCloud2 &cloud) {
+  updateDirections(scan);
+
+  if (cloud.fields.size() != 5) {
+    const char *names[] = {"x", "y", "z", "intensity", "ring"};
+    const uint32_t offsets[] = {0, 4, 8, kIntensityOffset, kRingOffset};
+    cloud.fields.resize(5);
+    for (size_t i = 0; i < 5; i++) {
+      cloud.fields[i].name = names[i];
+      cloud.fields[i].offset = offsets[i];
+      cloud.fields[i].datatype = i < 4 ? sensor_msgs::msg::PointField::FLOAT32
+                                       : sensor_msgs::msg::PointField::UINT16;
+      cloud.fields[i].count = 1;
+    }
+  }
+  cloud.header.stamp.sec = scan.header().stamp().sec();
+  cloud.header.stamp.nanosec = scan.header().stamp().nsec();
+  cloud.height = vertical_count_;
+  cloud.width = count_;
+  cloud.is_bigendian = false;
+  cloud.point_step = kPointStep;
+  cloud.row_step = kPointStep * count_;
+  cloud.is_dense = false;
+
+  const size_t rays = direction_x_.size();
+  const size_t ranges = std::min<size_t>(rays, scan.ranges_size());
+  const bool has_intensities = static_cast<size_t>(scan.intensities_size()) >= ranges;
+  cloud.data.resize(rays * kPointStep);
+  uint8_t *out = cloud.data.data();
+  const double *range = scan.ranges().data();
+  const double *intensity = scan.intensities().data();
+
+  for (uint32_t ring = 0; ring < vertical_count_; ring++) {
+    const size_t row_end = std::min<size_t>(static_cast<size_t>(ring + 1) * count_, ranges);
+    size_t i = static_cast<size_t>(ring) * count_;
+#ifdef __SSE2__
+    // Four rays at a time, transposed from per-coordinate registers into the two halves of four
+    // points: x, y, z and padding, then intensity, ring and padding
+    const __m128 ring_bits = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(ring)));
+    for (; i + 4 <= row_end; i += 4) {
+      const __m128 r = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(range + i)),
+                                     _mm_cvtpd_ps(_mm_loadu_pd(range + i + 2)));
+      __m128 x = _mm_mul_ps(r, _mm_loadu_ps(direction_x_.data() + i));
+      __m128 y = _mm_mul_ps(r, _mm_loadu_ps(direction_y_.data() + i));
+      __m128 z = _mm_mul_ps(r, _mm_loadu_ps(direction_z_.data() + i));
+      __m128 padding = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS(x, y, z, padding);
+      __m128 w = has_intensities ? _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(intensity + i)),
+                                                 _mm_cvtpd_ps(_mm_loadu_pd(intensity + i + 2)))
+                                 : _mm_setzero_ps();
+      __m128 rings = ring_bits;
+      __m128 zero_a = _mm_setzero_ps();
+      __m128 zero_b = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS(w, rings, zero_a, zero_b);
+      float *point = reinterpret_cast<float *>(out + i * kPointStep);
+      _mm_storeu_ps(point, x);
+      _mm_storeu_ps(point + 4, w);
+      _mm_storeu_ps(point + 8, y);
+      _mm_storeu_ps(point + 12, rings);
+      _mm_storeu_ps(point + 16, z);
+      _mm_storeu_ps(point + 20, zero_a);
+      _mm_storeu_ps(point + 24, padding);
+      _mm_storeu_ps(point + 28, zero_b);
+    }
+#endif
+    for (; i < row_end; i++) {
+      const float r = static_cast<float>(range[i]);
+      writePoint(out + i * kPointStep, r * direction_x_[i], r * direction_y_[i], r * direction_z_[i],
+                 has_intensities ? static_cast<float>(intensity[i]) : 0.0f, ring);
+    }
+  }
+  // A short scan leaves the remaining rays without a return
+  const float infinity = std::numeric_limits<float>::infinity();
+  for (size_t i = ranges; i < rays; i++) {
+    writePoint(out + i * kPointStep, infinity, infinity, infinity, 0.0f,
+               static_cast<uint32_t>(i / count_));
+  }
+  return;
+};
+}  // namespace ignition_platform
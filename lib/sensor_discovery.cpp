@@ -0,0 +1,143 @@
+/*!*******************************************************************************************
+ *  \file       sensor_discovery.cpp
+ *  \brief      Discovery of the sensors of a model from the ignition topic list
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "sensor_discovery.hpp"
+
+namespace ignition_platform {
+static std::vector<std::string> splitTopic(const std::string &topic) {
+  std::vector<std::string> tokens;
+  std::size_t last_pos = 0;
+  while (last_pos <= topic.size()) {
+    std::size_t pos = topic.find('/', last_pos);
+    if (pos == std::string::npos) {
+      pos = topic.size();
+    }
+    tokens.emplace_back(topic.substr(last_pos, pos - last_pos));
+    last_pos = pos + 1;
+  }
+  return tokens;
+};
+
+SensorDiscovery::SensorDiscovery(std::shared_ptr<ignition::transport::Node> ign_node,
+                                 const std::string &model_name,
+                                 std::chrono::milliseconds period)
+    : ign_node_ptr_(ign_node), model_name_(model_name), period_(period) {
+  thread_ = std::thread(&SensorDiscovery::run, this);
+};
+
+SensorDiscovery::~SensorDiscovery() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_condition_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+};
+
+std::vector<SensorConfig> SensorDiscovery::takeNewSensors() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<SensorConfig> sensors;
+  sensors.swap(new_sensors_);
+  return sensors;
+};
+
+std::string SensorDiscovery::getWorldName() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return world_name_;
+};
+
+bool SensorDiscovery::parseWorldName(const std::string &topic,
+                                     const std::string &model_name,
+                                     std::string &world_name) {
+  std::vector<std::string> tokens = splitTopic(topic);
+  if (tokens.size() < 5 || tokens[1] != "world" || tokens[3] != "model" ||
+      tokens[4] != model_name) {
+    return false;
+  }
+  world_name = tokens[2];
+  return true;
+};
+
+bool SensorDiscovery::parseSensorTopic(const std::string &topic,
+                                       const std::string &model_name,
+                                       SensorConfig &config) {
+  std::vector<std::string> tokens = splitTopic(topic);
+  if (tokens.size() < 12 || tokens[1] != "world" || tokens[3] != "model" ||
+      tokens[4] != model_name || tokens[5] != "model" || tokens[7] != "link" ||
+      tokens[9] != "sensor") {
+    return false;
+  }
+  config.world_name = tokens[2];
+  config.model_name = tokens[4];
+  config.sensor_name = tokens[6];
+  config.link_name = tokens[8];
+  config.sensor_type = tokens[10];
+  return true;
+};
+
+void SensorDiscovery::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    lock.unlock();
+    scan();
+    lock.lock();
+    stop_condition_.wait_for(lock, period_, [this]() { return stop_; });
+  }
+};
+
+void SensorDiscovery::scan() {
+  // TopicList waits for the discovery service to be ready, so it is kept off the ROS threads
+  std::vector<std::string> topics;
+  ign_node_ptr_->TopicList(topics);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &topic : topics) {
+    if (world_name_.empty()) {
+      parseWorldName(topic, model_name_, world_name_);
+    }
+
+    SensorConfig config;
+    if (!parseSensorTopic(topic, model_name_, config)) {
+      continue;
+    }
+    if (known_sensors_.insert(config.sensor_name).second) {
+      new_sensors_.emplace_back(config);
+    }
+  }
+};
+}  // namespace ignition_platform
@@ -0,0 +1,306 @@
+/*!*******************************************************************************************
+ *  \file       stream_recorder.cpp
+ *  \brief      Recording and replay of raw ignition sensor streams
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "stream_recorder.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace ignition_platform {
+static const char kMagic[8] = {'I', 'G', 'N', 'R', 'E', 'C', '0', '1'};
+
+static size_t recordSize(size_t payload) {
+  return (sizeof(RecordHeader) + payload + 7) & ~static_cast<size_t>(7);
+};
+
+static std::string segmentPath(const std::string &path, size_t index) {
+  return path + "." + std::to_string(index);
+};
+
+struct StreamRecorder::Segment {
+  int fd = -1;
+  char *data = nullptr;
+  size_t capacity = 0;
+  size_t offset = 0;
+
+  // Writers keep the segment alive until their record is committed, then it is trimmed to the
+  // space actually used
+  ~Segment() {
+    munmap(data, capacity);
+    if (ftruncate(fd, offset) != 0) {
+      std::cerr << "Could not trim recording segment: " << std::strerror(errno) << std::endl;
+    }
+    close(fd);
+  };
+};
+
+StreamRecorder::StreamRecorder(const std::string &path, size_t segment_size)
+    : path_(path), segment_size_(std::max(segment_size, static_cast<size_t>(1 << 20))) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  openSegment();
+};
+
+StreamRecorder::~StreamRecorder() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  segment_.reset();
+};
+
+bool StreamRecorder::openSegment() {
+  segment_.reset();
+  const std::string path = segmentPath(path_, segment_index_++);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Could not create recording segment " << path << ": " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  if (ftruncate(fd, segment_size_) != 0) {
+    std::cerr << "Could not size recording segment " << path << ": " << std::strerror(errno)
+              << std::endl;
+    close(fd);
+    return false;
+  }
+  // Populated upfront so that recording does not page fault on every new page
+  void *data = mmap(nullptr, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (data == MAP_FAILED) {
+    std::cerr << "Could not map recording segment " << path << ": " << std::strerror(errno)
+              << std::endl;
+    close(fd);
+    return false;
+  }
+
+  auto segment = std::make_shared<Segment>();
+  segment->fd = fd;
+  segment->data = static_cast<char *>(data);
+  segment->capacity = segment_size_;
+  std::memcpy(segment->data, kMagic, sizeof(kMagic));
+  segment->offset = sizeof(kMagic);
+  segment_ = segment;
+
+  for (size_t id = 0; id < topics_.size(); id++) {
+    const auto &topic = topics_[id];
+    const size_t size = topic.first.size() + topic.second.size() + 2;
+    RecordHeader *header = reserveLocked(size);
+    if (!header) {
+      return false;
+    }
+    char *payload = reinterpret_cast<char *>(header + 1);
+    std::memcpy(payload, topic.first.c_str(), topic.first.size() + 1);
+    std::memcpy(payload + topic.first.size() + 1, topic.second.c_str(), topic.second.size() + 1);
+    commit(header, RecordHeader::TOPIC, static_cast<uint16_t>(id), 0, size);
+  }
+  return true;
+};
+
+uint16_t StreamRecorder::addTopic(const std::string &topic, const std::string &message_type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t id = 0; id < topics_.size(); id++) {
+    if (topics_[id].first == topic) {
+      return static_cast<uint16_t>(id);
+    }
+  }
+  const uint16_t id = static_cast<uint16_t>(topics_.size());
+  topics_.emplace_back(topic, message_type);
+
+  const size_t size = topic.size() + message_type.size() + 2;
+  RecordHeader *header = reserveLocked(size);
+  if (!header && openSegment()) {
+    // The new segment already starts with this definition
+    return id;
+  }
+  if (header) {
+    char *payload = reinterpret_cast<char *>(header + 1);
+    std::memcpy(payload, topic.c_str(), topic.size() + 1);
+    std::memcpy(payload + topic.size() + 1, message_type.c_str(), message_type.size() + 1);
+    commit(header, RecordHeader::TOPIC, id, 0, size);
+  }
+  return id;
+};
+
+RecordHeader *StreamRecorder::reserveLocked(size_t size) {
+  const size_t record_size = recordSize(size);
+  if (!segment_ || segment_->offset + record_size > segment_->capacity) {
+    return nullptr;
+  }
+  RecordHeader *header = reinterpret_cast<RecordHeader *>(segment_->data + segment_->offset);
+  segment_->offset += record_size;
+  return header;
+};
+
+RecordHeader *StreamRecorder::reserve(size_t size, std::shared_ptr<Segment> &segment) {
+  // Larger than a whole segment, it would never fit
+  if (recordSize(size) + sizeof(kMagic) > segment_size_) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  RecordHeader *header = reserveLocked(size);
+  if (!header) {
+    if (!openSegment()) {
+      return nullptr;
+    }
+    header = reserveLocked(size);
+  }
+  segment = segment_;
+  return header;
+};
+
+void StreamRecorder::commit(RecordHeader *header, uint16_t kind, uint16_t topic_id,
+                            int64_t receive_ns, size_t size) {
+  header->size = static_cast<uint32_t>(size);
+  header->topic_id = topic_id;
+  header->receive_ns = receive_ns;
+  // The kind marks the record as complete
+  __atomic_store_n(&header->kind, kind, __ATOMIC_RELEASE);
+  return;
+};
+
+StreamReplay::StreamReplay(std::shared_ptr<ignition::transport::Node> ign_node,
+                           const std::string &path, double speed,
+                           std::chrono::milliseconds start_delay)
+    : ign_node_ptr_(ign_node), speed_(speed), start_delay_(start_delay) {
+  for (size_t index = 0;; index++) {
+    const std::string segment_path = segmentPath(path, index);
+    int fd = open(segment_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      break;
+    }
+    struct stat file_stat;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) >= sizeof(kMagic)) {
+      data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+      std::cerr << "Skipping invalid recording segment " << segment_path << std::endl;
+      if (data != MAP_FAILED) {
+        munmap(data, file_stat.st_size);
+      }
+      continue;
+    }
+    segments_.push_back({static_cast<const char *>(data), static_cast<size_t>(file_stat.st_size)});
+  }
+
+  // Topics are advertised before playing, so that sensor discovery finds them
+  for (const auto &segment : segments_) {
+    size_t offset = sizeof(kMagic);
+    while (offset + sizeof(RecordHeader) <= segment.size) {
+      const auto *header = reinterpret_cast<const RecordHeader *>(segment.data + offset);
+      if (header->kind == 0 || offset + recordSize(header->size) > segment.size) {
+        break;
+      }
+      if (header->kind == RecordHeader::TOPIC && header->topic_id >= publishers_.size()) {
+        const char *topic = reinterpret_cast<const char *>(header + 1);
+        const char *message_type = topic + std::strlen(topic) + 1;
+        publishers_.resize(header->topic_id + 1);
+        message_types_.resize(header->topic_id + 1);
+        publishers_[header->topic_id] = ign_node_ptr_->Advertise(topic, message_type);
+        message_types_[header->topic_id] = message_type;
+      }
+      offset += recordSize(header->size);
+    }
+  }
+
+  thread_ = std::thread(&StreamReplay::run, this);
+};
+
+StreamReplay::~StreamReplay() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_condition_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  for (const auto &segment : segments_) {
+    munmap(const_cast<char *>(segment.data), segment.size);
+  }
+};
+
+void StreamReplay::run() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stop_condition_.wait_for(lock, start_delay_, [this]() { return stop_; })) {
+      return;
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  int64_t first_ns = -1;
+  std::string buffer;
+  for (const auto &segment : segments_) {
+    size_t offset = sizeof(kMagic);
+    while (offset + sizeof(RecordHeader) <= segment.size) {
+      const auto *header = reinterpret_cast<const RecordHeader *>(segment.data + offset);
+      if (header->kind == 0 || offset + recordSize(header->size) > segment.size) {
+        break;
+      }
+      offset += recordSize(header->size);
+      if (header->kind != RecordHeader::MESSAGE || header->topic_id >= publishers_.size()) {
+        continue;
+      }
+
+      // Paced on the receive times, scaled by the speed
+      if (first_ns < 0) {
+        first_ns = header->receive_ns;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (speed_ > 0.0) {
+        const auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                     std::chrono::nanoseconds(static_cast<int64_t>(
+                                         (header->receive_ns - first_ns) / speed_)));
+        stop_condition_.wait_until(lock, due, [this]() { return stop_; });
+      }
+      if (stop_) {
+        return;
+      }
+      lock.unlock();
+
+      buffer.assign(reinterpret_cast<const char *>(header + 1), header->size);
+      publishers_[header->topic_id].PublishRaw(buffer, message_types_[header->topic_id]);
+      messages_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  finished_.store(true, std::memory_order_release);
+  return;
+};
+}  // namespace ignition_platform
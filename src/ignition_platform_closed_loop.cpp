@@ -0,0 +1,325 @@
+/*!*******************************************************************************************
+ *  \file       ignition_platform_closed_loop.cpp
+ *  \brief      Command to state round trip benchmark with a stub vehicle
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// Round trip of the control path without Gazebo. A stub vehicle on an in-process ignition node
+// integrates the cmd_vel twists sent by the platform and publishes odometry and pose back, and
+// the benchmark measures how long a twist command takes to show up in the odometry.
+//
+//   ros2 run ignition_platform ignition_platform_closed_loop --ros-args
+//     --params-file <platform parameters> -p command_rates:=[10.0,50.0,100.0]
+//
+// Each command carries its id in the yaw rate, which the stub applies and reports back in the
+// odometry twist, so the command that caused each state is known exactly.
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include <as2_core/names/services.hpp>
+#include <as2_msgs/srv/set_control_mode.hpp>
+#include <std_srvs/srv/set_bool.hpp>
+
+#include "ignition_platform.hpp"
+#include "latency_histogram.hpp"
+
+namespace
+{
+  using SteadyClock = std::chrono::steady_clock;
+
+  // Yaw rates of the command ids, within the yaw rate limit of the platform
+  constexpr size_t kCommandIds = 1000;
+  constexpr double kYawRateStep = 1e-3;
+
+  uint64_t elapsedNs(SteadyClock::time_point from, SteadyClock::time_point to)
+  {
+    return to > from ? std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count() : 0;
+  }
+
+  uint64_t deviationNs(SteadyClock::duration interval, SteadyClock::duration period)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      interval > period ? interval - period : period - interval).count();
+  }
+
+  // Kinematic vehicle following the last cmd_vel, in the body frame like the Gazebo velocity
+  // controller
+  class StubVehicle
+  {
+  public:
+    StubVehicle(ignition::transport::Node &node, const std::string &drone_id, double rate)
+      : period_(std::chrono::duration_cast<SteadyClock::duration>(
+          std::chrono::duration<double>(1.0 / rate))),
+        odometry_pub_(node.Advertise<ignition::msgs::Odometry>("model/" + drone_id + "/odometry")),
+        pose_pub_(node.Advertise<ignition::msgs::Pose>("model/" + drone_id + "/pose"))
+    {
+      node.Subscribe("model/" + drone_id + "/cmd_vel", &StubVehicle::commandCallback, this);
+      odometry_.mutable_pose()->mutable_orientation()->set_w(1.0);
+      thread_ = std::thread(&StubVehicle::run, this);
+    }
+
+    ~StubVehicle()
+    {
+      stop_.store(true, std::memory_order_relaxed);
+      thread_.join();
+    }
+
+    // Deviation of the cmd_vel arrivals from the command period
+    ignition_platform::LatencyHistogram command_jitter;
+    std::atomic<int64_t> command_period_ns{0};
+
+  private:
+    void commandCallback(const ignition::msgs::Twist &msg)
+    {
+      const auto now = SteadyClock::now();
+      std::lock_guard<std::mutex> lock(mutex_);
+      const std::chrono::nanoseconds command_period(command_period_ns.load(std::memory_order_relaxed));
+      if (last_command_time_ != SteadyClock::time_point() && command_period.count() > 0)
+      {
+        command_jitter.record(deviationNs(now - last_command_time_, command_period));
+      }
+      last_command_time_ = now;
+      command_.CopyFrom(msg);
+    }
+
+    void run()
+    {
+      const double dt = std::chrono::duration<double>(period_).count();
+      auto next = SteadyClock::now();
+      while (!stop_.load(std::memory_order_relaxed))
+      {
+        ignition::msgs::Twist command;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          command.CopyFrom(command_);
+        }
+
+        const double c = std::cos(yaw_);
+        const double s = std::sin(yaw_);
+        auto *position = odometry_.mutable_pose()->mutable_position();
+        position->set_x(position->x() + (c * command.linear().x() - s * command.linear().y()) * dt);
+        position->set_y(position->y() + (s * command.linear().x() + c * command.linear().y()) * dt);
+        position->set_z(position->z() + command.linear().z() * dt);
+        yaw_ += command.angular().z() * dt;
+        auto *orientation = odometry_.mutable_pose()->mutable_orientation();
+        orientation->set_z(std::sin(yaw_ / 2.0));
+        orientation->set_w(std::cos(yaw_ / 2.0));
+        odometry_.mutable_twist()->mutable_linear()->CopyFrom(command.linear());
+        odometry_.mutable_twist()->mutable_angular()->CopyFrom(command.angular());
+
+        const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+        odometry_.mutable_header()->mutable_stamp()->set_sec(now_ns / 1000000000);
+        odometry_.mutable_header()->mutable_stamp()->set_nsec(now_ns % 1000000000);
+        odometry_pub_.Publish(odometry_);
+        pose_.mutable_header()->CopyFrom(odometry_.header());
+        pose_.mutable_position()->CopyFrom(odometry_.pose().position());
+        pose_.mutable_orientation()->CopyFrom(odometry_.pose().orientation());
+        pose_pub_.Publish(pose_);
+
+        next += period_;
+        std::this_thread::sleep_until(next);
+      }
+    }
+
+    SteadyClock::duration period_;
+    ignition::transport::Node::Publisher odometry_pub_;
+    ignition::transport::Node::Publisher pose_pub_;
+    std::mutex mutex_;
+    ignition::msgs::Twist command_;
+    SteadyClock::time_point last_command_time_;
+    ignition::msgs::Odometry odometry_;
+    ignition::msgs::Pose pose_;
+    double yaw_ = 0.0;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+  };
+
+  template <typename ServiceT>
+  bool call(rclcpp::Executor &executor, typename rclcpp::Client<ServiceT>::SharedPtr client,
+            typename ServiceT::Request::SharedPtr request)
+  {
+    if (!client->wait_for_service(std::chrono::seconds(5)))
+    {
+      return false;
+    }
+    auto future = client->async_send_request(request);
+    return executor.spin_until_future_complete(future, std::chrono::seconds(5)) ==
+             rclcpp::FutureReturnCode::SUCCESS &&
+           future.get()->success;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  rclcpp::init(argc, argv);
+
+  auto benchmark = std::make_shared<rclcpp::Node>("closed_loop");
+  const std::string drone_id = benchmark->declare_parameter<std::string>("drone_id", "drone0");
+  const double duration = benchmark->declare_parameter<double>("duration", 10.0);
+  const double vehicle_rate = benchmark->declare_parameter<double>("vehicle_rate", 250.0);
+  const std::vector<double> command_rates = benchmark->declare_parameter<std::vector<double>>(
+    "command_rates", std::vector<double>({10.0, 50.0, 100.0}));
+
+  auto ign_node = std::make_shared<ignition::transport::Node>();
+  StubVehicle vehicle(*ign_node, drone_id, vehicle_rate);
+
+  rclcpp::NodeOptions options;
+  options.arguments({"--ros-args", "-r", "__ns:=/" + drone_id});
+  options.parameter_overrides({rclcpp::Parameter("sensor_discovery_period", 0.0)});
+  auto platform = std::make_shared<ignition_platform::IgnitionPlatform>(options);
+
+  rclcpp::NodeOptions client_options;
+  client_options.arguments({"--ros-args", "-r", "__ns:=/" + drone_id});
+  client_options.use_global_arguments(false);
+  auto client_node = std::make_shared<rclcpp::Node>("closed_loop_client", client_options);
+
+  // Send time of each command id, and the arrival of the states that first reflect them
+  std::array<SteadyClock::time_point, kCommandIds> command_times;
+  std::array<bool, kCommandIds> command_seen;
+  command_seen.fill(true);
+  ignition_platform::LatencyHistogram command_to_state;
+  ignition_platform::LatencyHistogram state_jitter;
+  SteadyClock::time_point last_state_time;
+  const auto vehicle_period = std::chrono::duration_cast<SteadyClock::duration>(
+    std::chrono::duration<double>(1.0 / vehicle_rate));
+
+  auto odometry_sub = client_node->create_subscription<nav_msgs::msg::Odometry>(
+    std::string(as2_names::topics::sensor_measurements::base) + "odom",
+    as2_names::topics::sensor_measurements::qos,
+    [&](nav_msgs::msg::Odometry::ConstSharedPtr msg)
+    {
+      const auto now = SteadyClock::now();
+      if (last_state_time != SteadyClock::time_point())
+      {
+        state_jitter.record(deviationNs(now - last_state_time, vehicle_period));
+      }
+      last_state_time = now;
+
+      const long id = std::lround(msg->twist.twist.angular.z / kYawRateStep) - 1;
+      if (id < 0 || id >= static_cast<long>(kCommandIds) || command_seen[id])
+      {
+        return;
+      }
+      command_seen[id] = true;
+      command_to_state.record(elapsedNs(command_times[id], now));
+    });
+  auto command_pub = client_node->create_publisher<geometry_msgs::msg::TwistStamped>(
+    as2_names::topics::actuator_command::twist, as2_names::topics::actuator_command::qos);
+
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(platform);
+  executor.add_node(client_node);
+
+  // Speed commands in the ENU frame, so every command goes through the ENU to FLU conversion
+  auto arm = std::make_shared<std_srvs::srv::SetBool::Request>();
+  arm->data = true;
+  auto offboard = std::make_shared<std_srvs::srv::SetBool::Request>();
+  offboard->data = true;
+  auto control_mode = std::make_shared<as2_msgs::srv::SetControlMode::Request>();
+  control_mode->control_mode.yaw_mode = as2_msgs::msg::ControlMode::YAW_SPEED;
+  control_mode->control_mode.control_mode = as2_msgs::msg::ControlMode::SPEED;
+  control_mode->control_mode.reference_frame = as2_msgs::msg::ControlMode::LOCAL_ENU_FRAME;
+  if (!call<std_srvs::srv::SetBool>(
+        executor,
+        client_node->create_client<std_srvs::srv::SetBool>(as2_names::services::platform::set_arming_state),
+        arm) ||
+      !call<std_srvs::srv::SetBool>(
+        executor,
+        client_node->create_client<std_srvs::srv::SetBool>(as2_names::services::platform::set_offboard_mode),
+        offboard) ||
+      !call<as2_msgs::srv::SetControlMode>(
+        executor,
+        client_node->create_client<as2_msgs::srv::SetControlMode>(
+          as2_names::services::platform::set_platform_control_mode),
+        control_mode))
+  {
+    RCLCPP_ERROR(benchmark->get_logger(), "Could not arm the platform and set its control mode");
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  size_t sequence = 0;
+  for (double command_rate : command_rates)
+  {
+    const auto command_period = std::chrono::duration_cast<SteadyClock::duration>(
+      std::chrono::duration<double>(1.0 / command_rate));
+    const auto end = SteadyClock::now() + std::chrono::duration_cast<SteadyClock::duration>(
+      std::chrono::duration<double>(duration));
+    vehicle.command_period_ns.store(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(command_period).count());
+    vehicle.command_jitter.reset();
+    command_to_state.reset();
+    state_jitter.reset();
+    last_state_time = SteadyClock::time_point();
+    size_t sent = 0;
+
+    auto next_command = SteadyClock::now();
+    while (rclcpp::ok() && SteadyClock::now() < end)
+    {
+      const size_t id = sequence++ % kCommandIds;
+      geometry_msgs::msg::TwistStamped command;
+      command.header.stamp = client_node->now();
+      command.twist.linear.x = 0.5;
+      command.twist.angular.z = (id + 1) * kYawRateStep;
+      command_times[id] = SteadyClock::now();
+      command_seen[id] = false;
+      command_pub->publish(command);
+      sent++;
+
+      next_command += command_period;
+      while (SteadyClock::now() < next_command)
+      {
+        executor.spin_once(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          next_command - SteadyClock::now()));
+      }
+    }
+
+    RCLCPP_INFO(
+      benchmark->get_logger(),
+      "%6.1f Hz: %lu commands, %lu reached the state. Command to state p50 %.3f ms, p99 %.3f ms, "
+      "max %.3f ms. Jitter of cmd_vel p99 %.3f ms, of odometry p99 %.3f ms",
+      command_rate, static_cast<unsigned long>(sent),
+      static_cast<unsigned long>(command_to_state.count()),
+      command_to_state.percentile(50.0) * 1e-6, command_to_state.percentile(99.0) * 1e-6,
+      command_to_state.max() * 1e-6, vehicle.command_jitter.percentile(99.0) * 1e-6,
+      state_jitter.percentile(99.0) * 1e-6);
+  }
+
+  rclcpp::shutdown();
+  return 0;
+}
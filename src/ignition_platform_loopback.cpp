@@ -0,0 +1,500 @@
+/*!*******************************************************************************************
+ *  \file       ignition_platform_loopback.cpp
+ *  \brief      Synthetic ignition streams for load testing the platform
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// Load test of the platform without Gazebo. Synthetic sensor streams are published on an
+// in-process ignition node, using the same topic layout as the simulator, and a probe node
+// measures what the platform delivers on the ROS side.
+//
+//   ros2 run ignition_platform ignition_platform_loopback --ros-args
+//     --params-file <platform parameters> -p duration:=10.0 -p camera_rate:=30.0 ...
+//
+// Stamps are taken from the system clock when publishing, so the latency covers ignition
+// transport, conversion and ROS delivery. Per-stage figures are on /diagnostics as usual.
+//
+// A slow subscriber is emulated with probe_delay, the time each probe callback takes, and
+// probe_depth. The probe is best effort by default, which matches every platform publisher.
+// With probe_reliability:=reliable it only matches reliable publishers, for instance the
+// cameras with qos.camera.reliability:=reliable, and the resident memory reported at the end
+// shows what the publishers hold for it.
+//
+// With drone_count:=N the process hosts N platforms, each with its own streams and probes, as
+// the multi-vehicle mode of the node does. The drones after the first are named
+// <drone_id>_<n>. The report then adds the resident memory and CPU time per drone.
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include "ignition_platform.hpp"
+#include "latency_histogram.hpp"
+#include "sensor_channel.hpp"
+
+namespace
+{
+  using Clock = std::chrono::system_clock;
+
+  struct StreamReport
+  {
+    std::string name;
+    // Streams derived by the platform are compared against the stream they come from
+    const StreamReport *source = nullptr;
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> delivered{0};
+    ignition_platform::LatencyHistogram latency;
+  };
+
+  void stamp(ignition::msgs::Header *header)
+  {
+    const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now().time_since_epoch()).count();
+    header->mutable_stamp()->set_sec(static_cast<int64_t>(now_ns / 1000000000));
+    header->mutable_stamp()->set_nsec(static_cast<int32_t>(now_ns % 1000000000));
+  }
+
+  void setFrames(ignition::msgs::Header *header, const std::string &frame_id,
+                 const std::string &child_frame_id)
+  {
+    auto *frame = header->add_data();
+    frame->set_key("frame_id");
+    frame->add_value(frame_id);
+    auto *child_frame = header->add_data();
+    child_frame->set_key("child_frame_id");
+    child_frame->add_value(child_frame_id);
+  }
+
+  // Publishes one message at a fixed rate from its own thread. The message is filled once and
+  // only restamped, so the publisher itself costs little next to the platform.
+  template <typename IgnMsgT>
+  class SyntheticStream
+  {
+  public:
+    SyntheticStream(ignition::transport::Node &node, const std::string &topic, double rate,
+                    IgnMsgT msg, StreamReport *report)
+      : publisher_(node.Advertise<IgnMsgT>(topic)), msg_(std::move(msg)), report_(report)
+    {
+      const auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+      thread_ = std::thread([this, period]()
+      {
+        auto next = Clock::now();
+        while (!stop_.load(std::memory_order_relaxed))
+        {
+          stamp(msg_.mutable_header());
+          publisher_.Publish(msg_);
+          if (report_)
+          {
+            report_->sent.fetch_add(1, std::memory_order_relaxed);
+          }
+          next += period;
+          std::this_thread::sleep_until(next);
+        }
+      });
+    }
+
+    ~SyntheticStream()
+    {
+      stop_.store(true, std::memory_order_relaxed);
+      thread_.join();
+    }
+
+  private:
+    ignition::transport::Node::Publisher publisher_;
+    IgnMsgT msg_;
+    StreamReport *report_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+  };
+
+  template <typename RosMsgT>
+  rclcpp::SubscriptionBase::SharedPtr probe(rclcpp::Node &node, const std::string &topic,
+                                            const rclcpp::QoS &qos,
+                                            std::chrono::nanoseconds delay, StreamReport &report)
+  {
+    return node.create_subscription<RosMsgT>(
+      topic, qos,
+      [&report, delay](typename RosMsgT::ConstSharedPtr msg)
+      {
+        const int64_t stamp_ns = static_cast<int64_t>(msg->header.stamp.sec) * 1000000000 +
+                                 msg->header.stamp.nanosec;
+        const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now().time_since_epoch()).count();
+        report.delivered.fetch_add(1, std::memory_order_relaxed);
+        report.latency.record(now_ns > stamp_ns ? now_ns - stamp_ns : 0);
+        if (delay.count() > 0)
+        {
+          std::this_thread::sleep_for(delay);
+        }
+      });
+  }
+
+  double residentMiB()
+  {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0;
+    size_t resident = 0;
+    statm >> size >> resident;
+    return static_cast<double>(resident) * sysconf(_SC_PAGESIZE) / (1 << 20);
+  }
+
+  // User and system time of the whole process, including the synthetic streams and the probes
+  double cpuSeconds()
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+  }
+
+  double peakResidentMiB()
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // Reported in KiB on Linux
+    return usage.ru_maxrss / 1024.0;
+  }
+
+  // Same layout as the topics subscribed by IgnitionBridge::addSensor
+  template <typename IgnMsgT>
+  std::string sensorTopic(const std::string &world_name, const std::string &model_name,
+                          const std::string &sensor_name, const std::string &sensor_type)
+  {
+    return "/world/" + world_name + "/model/" + model_name + "/model/" + sensor_name + "/link/" +
+           sensor_name + "_link/sensor/" + sensor_type +
+           ignition_platform::SensorStream<IgnMsgT>::suffix;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  rclcpp::init(argc, argv);
+
+  auto loopback = std::make_shared<rclcpp::Node>("loopback");
+  const std::string drone_id = loopback->declare_parameter<std::string>("drone_id", "drone0");
+  const int64_t drone_count = loopback->declare_parameter<int64_t>("drone_count", 1);
+  const std::string world = loopback->declare_parameter<std::string>("world", "loopback");
+  const double duration = loopback->declare_parameter<double>("duration", 10.0);
+  const double warmup = loopback->declare_parameter<double>("warmup", 2.0);
+  const double camera_rate = loopback->declare_parameter<double>("camera_rate", 30.0);
+  const int64_t camera_width = loopback->declare_parameter<int64_t>("camera_width", 640);
+  const int64_t camera_height = loopback->declare_parameter<int64_t>("camera_height", 480);
+  const double lidar_rate = loopback->declare_parameter<double>("lidar_rate", 10.0);
+  const int64_t lidar_samples = loopback->declare_parameter<int64_t>("lidar_samples", 1024);
+  const double imu_rate = loopback->declare_parameter<double>("imu_rate", 200.0);
+  const double gps_rate = loopback->declare_parameter<double>("gps_rate", 10.0);
+  const double odometry_rate = loopback->declare_parameter<double>("odometry_rate", 100.0);
+  const double pose_static_rate = loopback->declare_parameter<double>("pose_static_rate", 1.0);
+  const double probe_delay = loopback->declare_parameter<double>("probe_delay", 0.0);
+  const int64_t probe_depth = loopback->declare_parameter<int64_t>("probe_depth", 5);
+  const std::string probe_reliability =
+    loopback->declare_parameter<std::string>("probe_reliability", "best_effort");
+
+  std::vector<std::string> drone_ids;
+  for (int64_t i = 0; i < std::max<int64_t>(drone_count, 1); i++)
+  {
+    drone_ids.emplace_back(i == 0 ? drone_id : drone_id + "_" + std::to_string(i));
+  }
+
+  rclcpp::QoS probe_qos = rclcpp::QoS(rclcpp::KeepLast(std::max<int64_t>(probe_depth, 1)));
+  if (probe_reliability == "reliable")
+  {
+    probe_qos.reliable();
+  }
+  else
+  {
+    probe_qos.best_effort();
+  }
+  const auto probe_delay_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::duration<double>(probe_delay));
+  const std::string base = as2_names::topics::sensor_measurements::base;
+
+  std::vector<std::unique_ptr<StreamReport>> reports;
+  auto addReport = [&reports](const std::string &name)
+  {
+    reports.emplace_back(std::make_unique<StreamReport>());
+    reports.back()->name = name;
+    return reports.back().get();
+  };
+
+  // What the platforms cost is measured from here
+  const double resident_baseline = residentMiB();
+
+  rclcpp::executors::SingleThreadedExecutor executor;
+  // A slow probe must not hold the platform timers, so the probes spin on their own thread
+  rclcpp::executors::SingleThreadedExecutor probe_executor;
+  std::vector<std::shared_ptr<ignition_platform::IgnitionPlatform>> platforms;
+  std::vector<rclcpp::Node::SharedPtr> probe_nodes;
+  std::vector<rclcpp::SubscriptionBase::SharedPtr> probes;
+
+  // Reports of each drone, in the order its streams are created below
+  struct DroneReports
+  {
+    StreamReport *camera = nullptr;
+    StreamReport *lidar = nullptr;
+    StreamReport *imu = nullptr;
+    StreamReport *gps = nullptr;
+    StreamReport *odometry = nullptr;
+  };
+  std::vector<DroneReports> drone_reports;
+
+  for (const auto &id : drone_ids)
+  {
+    std::vector<std::string> sensors;
+    if (camera_rate > 0.0)
+    {
+      sensors.emplace_back(world + "," + id + ",camera,camera_link,camera");
+    }
+    if (lidar_rate > 0.0)
+    {
+      sensors.emplace_back(world + "," + id + ",lidar,lidar_link,lidar");
+    }
+    if (gps_rate > 0.0)
+    {
+      sensors.emplace_back(world + "," + id + ",gps,gps_link,gps");
+    }
+    std::string sensors_param;
+    for (const auto &sensor : sensors)
+    {
+      sensors_param += (sensors_param.empty() ? "" : ":") + sensor;
+    }
+
+    rclcpp::NodeOptions options;
+    options.arguments({"--ros-args", "-r", "__ns:=/" + id});
+    // Only scans are published, the points are projected from them
+    options.parameter_overrides({rclcpp::Parameter("sensors", sensors_param),
+                                 rclcpp::Parameter("sensor_discovery_period", 0.0),
+                                 rclcpp::Parameter("lidar_points_from_scan", true)});
+    platforms.emplace_back(std::make_shared<ignition_platform::IgnitionPlatform>(options));
+    executor.add_node(platforms.back());
+
+    // The probe lives in the namespace of the platform so the relative topics match
+    rclcpp::NodeOptions probe_options;
+    probe_options.arguments({"--ros-args", "-r", "__ns:=/" + id});
+    probe_options.use_global_arguments(false);
+    auto probe_node = std::make_shared<rclcpp::Node>("loopback_probe", probe_options);
+    probe_executor.add_node(probe_node);
+    probe_nodes.emplace_back(probe_node);
+
+    const std::string prefix = drone_ids.size() > 1 ? id + "/" : "";
+    DroneReports drone;
+    if (camera_rate > 0.0)
+    {
+      drone.camera = addReport(prefix + "camera");
+      probes.emplace_back(probe<sensor_msgs::msg::Image>(
+        *probe_node, base + "camera/image_raw", probe_qos, probe_delay_ns, *drone.camera));
+    }
+    if (lidar_rate > 0.0)
+    {
+      drone.lidar = addReport(prefix + "lidar");
+      probes.emplace_back(probe<sensor_msgs::msg::LaserScan>(
+        *probe_node, base + "lidar", probe_qos, probe_delay_ns, *drone.lidar));
+      // Projected from the scan
+      auto *points_report = addReport(prefix + "lidar/points");
+      points_report->source = drone.lidar;
+      probes.emplace_back(probe<sensor_msgs::msg::PointCloud2>(
+        *probe_node, base + "lidar/points", probe_qos, probe_delay_ns, *points_report));
+    }
+    if (imu_rate > 0.0)
+    {
+      drone.imu = addReport(prefix + "imu");
+      probes.emplace_back(probe<sensor_msgs::msg::Imu>(
+        *probe_node, base + "imu", probe_qos, probe_delay_ns, *drone.imu));
+    }
+    if (gps_rate > 0.0)
+    {
+      drone.gps = addReport(prefix + "gps");
+      probes.emplace_back(probe<sensor_msgs::msg::NavSatFix>(
+        *probe_node, base + "gps", probe_qos, probe_delay_ns, *drone.gps));
+    }
+    if (odometry_rate > 0.0)
+    {
+      drone.odometry = addReport(prefix + "odom");
+      probes.emplace_back(probe<nav_msgs::msg::Odometry>(
+        *probe_node, base + "odom", probe_qos, probe_delay_ns, *drone.odometry));
+    }
+    drone_reports.emplace_back(drone);
+  }
+
+  std::thread probe_thread([&probe_executor]() { probe_executor.spin(); });
+  auto spinFor = [&executor](double seconds)
+  {
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(seconds));
+    while (rclcpp::ok() && std::chrono::steady_clock::now() < deadline)
+    {
+      executor.spin_once(std::chrono::milliseconds(10));
+    }
+  };
+
+  // Lets the platforms subscribe, including the streams only subscribed on demand
+  spinFor(warmup);
+  const double resident_before = residentMiB();
+
+  // The synthetic streams publish from their own node, as the simulator would
+  auto ign_node = std::make_shared<ignition::transport::Node>();
+  std::vector<std::shared_ptr<void>> streams;
+  for (size_t d = 0; d < drone_ids.size(); d++)
+  {
+    const std::string &id = drone_ids[d];
+    const DroneReports &drone = drone_reports[d];
+    if (camera_rate > 0.0)
+    {
+      ignition::msgs::Image image;
+      image.set_width(camera_width);
+      image.set_height(camera_height);
+      image.set_pixel_format_type(ignition::msgs::PixelFormatType::RGB_INT8);
+      image.set_step(camera_width * 3);
+      image.mutable_data()->resize(camera_width * camera_height * 3);
+      streams.emplace_back(std::make_shared<SyntheticStream<ignition::msgs::Image>>(
+        *ign_node, sensorTopic<ignition::msgs::Image>(world, id, "camera", "camera"),
+        camera_rate, image, drone.camera));
+
+      ignition::msgs::CameraInfo camera_info;
+      camera_info.set_width(camera_width);
+      camera_info.set_height(camera_height);
+      for (double k : {500.0, 0.0, camera_width / 2.0, 0.0, 500.0, camera_height / 2.0, 0.0, 0.0, 1.0})
+      {
+        camera_info.mutable_intrinsics()->add_k(k);
+      }
+      streams.emplace_back(std::make_shared<SyntheticStream<ignition::msgs::CameraInfo>>(
+        *ign_node, sensorTopic<ignition::msgs::CameraInfo>(world, id, "camera", "camera"),
+        camera_rate, camera_info, nullptr));
+    }
+    if (lidar_rate > 0.0)
+    {
+      ignition::msgs::LaserScan scan;
+      scan.set_frame(id + "::lidar");
+      scan.set_count(lidar_samples);
+      scan.set_angle_min(-M_PI);
+      scan.set_angle_max(M_PI);
+      scan.set_angle_step(2.0 * M_PI / lidar_samples);
+      scan.set_range_min(0.1);
+      scan.set_range_max(30.0);
+      scan.set_vertical_count(1);
+      scan.mutable_ranges()->Resize(lidar_samples, 5.0);
+      scan.mutable_intensities()->Resize(lidar_samples, 1.0);
+      streams.emplace_back(std::make_shared<SyntheticStream<ignition::msgs::LaserScan>>(
+        *ign_node, sensorTopic<ignition::msgs::LaserScan>(world, id, "lidar", "lidar"),
+        lidar_rate, scan, drone.lidar));
+    }
+    if (imu_rate > 0.0)
+    {
+      ignition::msgs::IMU imu;
+      imu.mutable_orientation()->set_w(1.0);
+      imu.mutable_linear_acceleration()->set_z(9.81);
+      streams.emplace_back(std::make_shared<SyntheticStream<ignition::msgs::IMU>>(
+        *ign_node,
+        "world/" + world + "/model/" + id + "/link/base_link/sensor/imu_sensor" +
+        ignition_platform::SensorStream<ignition::msgs::IMU>::suffix,
+        imu_rate, imu, drone.imu));
+    }
+    if (gps_rate > 0.0)
+    {
+      ignition::msgs::NavSat navsat;
+      navsat.set_frame_id(id + "::gps");
+      navsat.set_latitude_deg(40.4);
+      navsat.set_longitude_deg(-3.7);
+      navsat.set_altitude(650.0);
+      streams.emplace_back(std::make_shared<SyntheticStream<ignition::msgs::NavSat>>(
+        *ign_node, sensorTopic<ignition::msgs::NavSat>(world, id, "gps", "gps"),
+        gps_rate, navsat, drone.gps));
+    }
+    if (odometry_rate > 0.0)
+    {
+      ignition::msgs::Odometry odometry;
+      odometry.mutable_pose()->mutable_orientation()->set_w(1.0);
+      streams.emplace_back(std::make_shared<SyntheticStream<ignition::msgs::Odometry>>(
+        *ign_node, "model/" + id + "/odometry", odometry_rate, odometry, drone.odometry));
+    }
+    if (pose_static_rate > 0.0)
+    {
+      ignition::msgs::Pose_V poses;
+      for (const char *sensor : {"camera", "lidar", "gps"})
+      {
+        auto *pose = poses.add_pose();
+        pose->set_name(id + "/" + sensor);
+        setFrames(pose->mutable_header(), id, id + "/" + sensor);
+        pose->mutable_orientation()->set_w(1.0);
+      }
+      streams.emplace_back(std::make_shared<SyntheticStream<ignition::msgs::Pose_V>>(
+        *ign_node, "model/" + id + "/pose_static", pose_static_rate, poses, nullptr));
+    }
+  }
+
+  const double cpu_before = cpuSeconds();
+  spinFor(duration);
+  const double cpu_seconds = cpuSeconds() - cpu_before;
+  const double resident_after = residentMiB();
+  streams.clear();
+  // Messages still in flight when the publishers stopped
+  spinFor(0.2);
+  probe_executor.cancel();
+  probe_thread.join();
+
+  for (const auto &report : reports)
+  {
+    const uint64_t expected = (report->source ? report->source : report.get())->sent.load();
+    const uint64_t delivered = report->delivered.load();
+    RCLCPP_INFO(
+      loopback->get_logger(),
+      "%-14s sent %8lu  delivered %8lu (%8.1f Hz)  dropped %5.1f %%  "
+      "latency p50 %7.3f ms  p99 %7.3f ms  max %7.3f ms",
+      report->name.c_str(), static_cast<unsigned long>(expected),
+      static_cast<unsigned long>(delivered), delivered / duration,
+      expected > 0 ? 100.0 * (1.0 - static_cast<double>(delivered) / expected) : 0.0,
+      report->latency.percentile(50.0) / 1e6, report->latency.percentile(99.0) / 1e6,
+      report->latency.max() / 1e6);
+  }
+  RCLCPP_INFO(loopback->get_logger(),
+              "resident memory %.1f MiB before the streams, %.1f MiB at the end, peak %.1f MiB",
+              resident_before, resident_after, peakResidentMiB());
+  // The CPU time includes the synthetic streams and the probes of each drone
+  const double drones = static_cast<double>(drone_ids.size());
+  RCLCPP_INFO(loopback->get_logger(),
+              "per drone over %zu drones: %.1f MiB resident idle, %.1f MiB with its streams, "
+              "%.1f %% of a core",
+              drone_ids.size(), (resident_before - resident_baseline) / drones,
+              (resident_after - resident_baseline) / drones,
+              100.0 * cpu_seconds / duration / drones);
+
+  rclcpp::shutdown();
+  return 0;
+}
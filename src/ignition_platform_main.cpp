@@ -37,13 +37,60 @@
 
 #include "ignition_platform.hpp"
 
+// Host every drone in drone_ids inside this process, sharing one ROS context and executor. Each
+// platform subscribes through its own ignition node.
+int runMultiVehicle(std::shared_ptr<rclcpp::Node> manager, const std::vector<std::string> &drone_ids)
+{
+  rclcpp::executors::MultiThreadedExecutor executor(
+    rclcpp::ExecutorOptions(), manager->declare_parameter<int64_t>("executor_threads", 2));
+  std::vector<std::shared_ptr<ignition_platform::IgnitionPlatform>> platforms;
+
+  // A single platform republishes the shared ignition clock
+  bool publish_clock = manager->declare_parameter<bool>("publish_clock", false);
+
+  for (const auto &drone_id : drone_ids)
+  {
+    std::string sensors = manager->declare_parameter<std::string>(drone_id + ".sensors", "");
+
+    rclcpp::NodeOptions options;
+    options.arguments({"--ros-args", "-r", "__ns:=/" + drone_id});
+    options.parameter_overrides({rclcpp::Parameter("sensors", sensors),
+                                 rclcpp::Parameter("publish_clock", publish_clock && platforms.empty())});
+
+    auto platform = std::make_shared<ignition_platform::IgnitionPlatform>(options);
+    executor.add_node(platform);
+    platforms.emplace_back(platform);
+  }
+
+  executor.spin();
+  return 0;
+}
+
 int main(int argc, char * argv[])
 {
   rclcpp::init(argc, argv);
+
+  std::vector<std::string> drone_ids;
+  {
+    auto manager = std::make_shared<rclcpp::Node>("ignition_platform_manager");
+    drone_ids = manager->declare_parameter<std::vector<std::string>>(
+      "drone_ids", std::vector<std::string>());
+    if (!drone_ids.empty())
+    {
+      runMultiVehicle(manager, drone_ids);
+      rclcpp::shutdown();
+      return 0;
+    }
+  }
+
+  // Every callback runs on its timer or event, with the control path and the sensor bookkeeping
+  // of the platform in separate callback groups
   auto node = std::make_shared<ignition_platform::IgnitionPlatform>();
-  node->preset_loop_frequency(60);
-  as2::spinLoop(node);  
-  
+  rclcpp::executors::MultiThreadedExecutor executor(
+    rclcpp::ExecutorOptions(), node->get_parameter("executor_threads").as_int());
+  executor.add_node(node);
+  executor.spin();
+
   rclcpp::shutdown();
   return 0;
 }
@@ -0,0 +1,81 @@
+/*!*******************************************************************************************
+ *  \file       allocation_counter.hpp
+ *  \brief      Allocation counting for tests and benchmarks
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef ALLOCATION_COUNTER_HPP_
+#define ALLOCATION_COUNTER_HPP_
+
+#include <cstdint>
+
+namespace ignition_platform
+{
+  namespace test
+  {
+    // Calls to the global operator new made by the calling thread, and the bytes they asked
+    // for. Only counted in executables that link allocation_counter.cpp, which replaces the
+    // global allocation functions.
+    struct AllocationCount
+    {
+      uint64_t allocations = 0;
+      uint64_t bytes = 0;
+    };
+
+    AllocationCount threadAllocations();
+
+    // Allocations made by the calling thread while it is in scope
+    class AllocationScope
+    {
+    public:
+      AllocationScope()
+      : start_(threadAllocations())
+      {
+      }
+
+      AllocationCount count() const
+      {
+        const AllocationCount now = threadAllocations();
+        AllocationCount count;
+        count.allocations = now.allocations - start_.allocations;
+        count.bytes = now.bytes - start_.bytes;
+        return count;
+      }
+
+    private:
+      AllocationCount start_;
+    };
+  }
+}
+
+#endif  // ALLOCATION_COUNTER_HPP_
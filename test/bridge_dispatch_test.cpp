@@ -0,0 +1,144 @@
+/*!*******************************************************************************************
+ *  \file       bridge_dispatch_test.cpp
+ *  \brief      Per-sensor dispatch of the bridge handlers at 1 kHz
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// Base link sensors published on an in-process ignition node reach the handler bound to their own
+// subscription, and a 1 kHz IMU stream goes through the bridge without losing a message. The time
+// spent per message, from the stats the bridge keeps for /diagnostics, is only recorded: timing
+// limits belong to BM_ImuThroughBridge in the benchmarks, not to a test on a shared runner.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "ignition_bridge.hpp"
+
+namespace
+{
+  const std::string kWorld = "dispatch";
+  const std::string kNamespace = "/drone0";
+
+  std::string baseLinkTopic(const std::string & sensor_name, const char * suffix)
+  {
+    return "world/" + kWorld + "/model" + kNamespace + "/link/base_link/sensor/" + sensor_name +
+           suffix;
+  }
+
+  // Delivery is asynchronous, so wait for the expected count with a deadline
+  bool waitFor(const std::atomic<uint64_t> & counter, uint64_t expected,
+               std::chrono::milliseconds timeout = std::chrono::milliseconds(2000))
+  {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (counter.load() < expected && std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return counter.load() >= expected;
+  }
+}
+
+TEST(BridgeDispatchTest, BaseLinkSensorsReachOnlyTheirHandlers)
+{
+  ignition_platform::IgnitionBridge bridge(kNamespace);
+  std::atomic<uint64_t> imu{0};
+  std::atomic<uint64_t> air_pressure{0};
+  std::atomic<uint64_t> magnetometer{0};
+  bridge.setImuCallback([&imu](sensor_msgs::msg::Imu &) { imu++; }, kWorld);
+  bridge.setAirPressureCallback(
+    [&air_pressure](sensor_msgs::msg::FluidPressure &) { air_pressure++; }, kWorld);
+  bridge.setMagnetometerCallback(
+    [&magnetometer](sensor_msgs::msg::MagneticField &) { magnetometer++; }, kWorld);
+
+  ignition::transport::Node publisher_node;
+  auto imu_pub = publisher_node.Advertise<ignition::msgs::IMU>(
+    baseLinkTopic("imu_sensor", ignition_platform::SensorStream<ignition::msgs::IMU>::suffix));
+  auto air_pressure_pub = publisher_node.Advertise<ignition::msgs::FluidPressure>(
+    baseLinkTopic("air_pressure", ignition_platform::SensorStream<ignition::msgs::FluidPressure>::suffix));
+  auto magnetometer_pub = publisher_node.Advertise<ignition::msgs::Magnetometer>(
+    baseLinkTopic("magnetometer", ignition_platform::SensorStream<ignition::msgs::Magnetometer>::suffix));
+
+  imu_pub.Publish(ignition::msgs::IMU());
+  air_pressure_pub.Publish(ignition::msgs::FluidPressure());
+  air_pressure_pub.Publish(ignition::msgs::FluidPressure());
+  magnetometer_pub.Publish(ignition::msgs::Magnetometer());
+  magnetometer_pub.Publish(ignition::msgs::Magnetometer());
+  magnetometer_pub.Publish(ignition::msgs::Magnetometer());
+
+  EXPECT_TRUE(waitFor(magnetometer, 3));
+  EXPECT_TRUE(waitFor(air_pressure, 2));
+  EXPECT_TRUE(waitFor(imu, 1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(imu.load(), 1u);
+  EXPECT_EQ(air_pressure.load(), 2u);
+  EXPECT_EQ(magnetometer.load(), 3u);
+}
+
+TEST(BridgeDispatchTest, ImuAt1kHz)
+{
+  constexpr uint64_t kMessages = 2000;
+  const auto period = std::chrono::microseconds(1000);
+
+  ignition_platform::IgnitionBridge bridge(kNamespace);
+  std::atomic<uint64_t> delivered{0};
+  bridge.setImuCallback([&delivered](sensor_msgs::msg::Imu &) { delivered++; }, kWorld);
+
+  ignition::transport::Node publisher_node;
+  auto imu_pub = publisher_node.Advertise<ignition::msgs::IMU>(
+    baseLinkTopic("imu_sensor", ignition_platform::SensorStream<ignition::msgs::IMU>::suffix));
+  ignition::msgs::IMU imu;
+  imu.mutable_orientation()->set_w(1.0);
+  imu.mutable_linear_acceleration()->set_z(9.81);
+
+  auto next = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < kMessages; i++)
+  {
+    imu.mutable_header()->mutable_stamp()->set_nsec(static_cast<int32_t>(i));
+    imu_pub.Publish(imu);
+    next += period;
+    std::this_thread::sleep_until(next);
+  }
+  ASSERT_TRUE(waitFor(delivered, kMessages));
+
+  const auto & stats = *bridge.getSensorStats().at("imu");
+  EXPECT_EQ(stats.received.load(), kMessages);
+  EXPECT_EQ(stats.published.load(), kMessages);
+  ::testing::Test::RecordProperty("conversion_p50_ns", static_cast<int>(stats.conversion_time.percentile(50.0)));
+  ::testing::Test::RecordProperty("conversion_p99_ns", static_cast<int>(stats.conversion_time.percentile(99.0)));
+  ::testing::Test::RecordProperty("dispatch_p50_ns", static_cast<int>(stats.dispatch_time.percentile(50.0)));
+  ::testing::Test::RecordProperty("dispatch_p99_ns", static_cast<int>(stats.dispatch_time.percentile(99.0)));
+}
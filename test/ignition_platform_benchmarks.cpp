@@ -0,0 +1,932 @@
+/*!*******************************************************************************************
+ *  \file       ignition_platform_benchmarks.cpp
+ *  \brief      Conversion benchmarks of the bridge hot paths
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// Hot path benchmarks of the bridge, fed with synthetic ignition messages and no simulator.
+//
+//   ignition_platform_benchmarks [--benchmark_filter=<regex>]
+//
+// Sensor streams go through the SensorChannel the bridge converts them with, which is what runs
+// per message on the transport thread or on the conversion workers. Odometry and pose_static go
+// through an IgnitionBridge, published on an in-process ignition node, so their figures also
+// include the ignition dispatch to the bridge handler.
+//
+// Besides the time per message, every benchmark reports per message:
+//   allocs_per_msg        calls to operator new made by the benchmark thread
+//   alloc_bytes_per_msg   bytes those calls asked for
+//   bytes_copied_per_msg  bytes written into the ROS messages handed to the platform: fixed size
+//                         fields by their size, strings and arrays by their length
+//
+// The image kernels run both dispatched, labelled with the instruction set picked for this CPU,
+// and as plain scalar loops, and the dispatched output is checked against the scalar one. The
+// voxel filter output is checked against the number of distinct voxels counted with a std::set,
+// and the projected lidar points against a double precision projection of the same scan.
+//
+// The stream recorder writes its segments to the temporary directory and removes them afterwards.
+// BM_OdometryUnderCameraLoad runs for a few seconds in real time and reports the delay of the
+// odometry ticks instead of a time per message.
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <sensor_msgs/image_encodings.hpp>
+
+#include "allocation_counter.hpp"
+#include "ignition_bridge.hpp"
+#include "image_kernels.hpp"
+#include "image_pipeline.hpp"
+#include "point_cloud_filter.hpp"
+#include "scan_projector.hpp"
+#include "sensor_channel.hpp"
+#include "sensor_sync.hpp"
+#include "stream_policy.hpp"
+#include "stream_recorder.hpp"
+
+namespace
+{
+  using ignition_platform::SensorStats;
+  using ignition_platform::makeSensorChannel;
+  using ignition_platform::test::AllocationCount;
+  using ignition_platform::test::AllocationScope;
+
+  const std::string kWorld = "benchmark";
+  const std::string kModel = "drone0";
+
+  // Bytes written by the conversion into each ROS message
+  size_t copiedBytes(const std_msgs::msg::Header & header)
+  {
+    return sizeof(header.stamp) + header.frame_id.size();
+  }
+
+  size_t copiedBytes(const sensor_msgs::msg::Image & msg)
+  {
+    return copiedBytes(msg.header) + sizeof(msg.height) + sizeof(msg.width) + msg.encoding.size() +
+           sizeof(msg.is_bigendian) + sizeof(msg.step) + msg.data.size();
+  }
+
+  size_t copiedBytes(const sensor_msgs::msg::PointCloud2 & msg)
+  {
+    size_t bytes = copiedBytes(msg.header) + sizeof(msg.height) + sizeof(msg.width) +
+                   sizeof(msg.is_bigendian) + sizeof(msg.point_step) + sizeof(msg.row_step) +
+                   sizeof(msg.is_dense) + msg.data.size();
+    for (const auto & field : msg.fields)
+    {
+      bytes += field.name.size() + sizeof(field.offset) + sizeof(field.datatype) + sizeof(field.count);
+    }
+    return bytes;
+  }
+
+  size_t copiedBytes(const sensor_msgs::msg::LaserScan & msg)
+  {
+    return copiedBytes(msg.header) + 7 * sizeof(float) +
+           (msg.ranges.size() + msg.intensities.size()) * sizeof(float);
+  }
+
+  size_t copiedBytes(const sensor_msgs::msg::Imu & msg)
+  {
+    return copiedBytes(msg.header) + sizeof(msg.orientation) + sizeof(msg.orientation_covariance) +
+           sizeof(msg.angular_velocity) + sizeof(msg.angular_velocity_covariance) +
+           sizeof(msg.linear_acceleration) + sizeof(msg.linear_acceleration_covariance);
+  }
+
+  size_t copiedBytes(const sensor_msgs::msg::NavSatFix & msg)
+  {
+    return copiedBytes(msg.header) + sizeof(msg.status.status) + sizeof(msg.status.service) +
+           sizeof(msg.latitude) + sizeof(msg.longitude) + sizeof(msg.altitude) +
+           sizeof(msg.position_covariance) + sizeof(msg.position_covariance_type);
+  }
+
+  size_t copiedBytes(const nav_msgs::msg::Odometry & msg)
+  {
+    return copiedBytes(msg.header) + msg.child_frame_id.size() + sizeof(msg.pose) + sizeof(msg.twist);
+  }
+
+  size_t copiedBytes(const geometry_msgs::msg::TransformStamped & msg)
+  {
+    return copiedBytes(msg.header) + msg.child_frame_id.size() + sizeof(msg.transform);
+  }
+
+  void stamp(ignition::msgs::Header * header, int64_t i, const std::string & frame_id)
+  {
+    header->mutable_stamp()->set_sec(i / 1000);
+    header->mutable_stamp()->set_nsec(static_cast<int32_t>((i % 1000) * 1000000));
+    if (header->data_size() == 0)
+    {
+      auto * frame = header->add_data();
+      frame->set_key("frame_id");
+      frame->add_value(frame_id);
+    }
+  }
+
+  ignition::msgs::Image syntheticImage(int64_t width, int64_t height)
+  {
+    ignition::msgs::Image image;
+    stamp(image.mutable_header(), 0, kModel + "::camera::camera_link::camera");
+    image.set_width(width);
+    image.set_height(height);
+    image.set_step(width * 3);
+    image.set_pixel_format_type(ignition::msgs::PixelFormatType::RGB_INT8);
+    image.mutable_data()->resize(width * height * 3, '\x40');
+    return image;
+  }
+
+  // Same layout as the clouds of the gpu_lidar sensor: x, y, z, intensity and ring in 32 bytes
+  ignition::msgs::PointCloudPacked syntheticCloud(int64_t width, int64_t height)
+  {
+    ignition::msgs::PointCloudPacked cloud;
+    stamp(cloud.mutable_header(), 0, kModel + "::lidar::lidar_link::lidar");
+    const std::pair<const char *, uint32_t> fields[] = {
+      {"x", 0}, {"y", 4}, {"z", 8}, {"intensity", 16}, {"ring", 20}};
+    for (const auto & field : fields)
+    {
+      auto * packed_field = cloud.add_field();
+      packed_field->set_name(field.first);
+      packed_field->set_offset(field.second);
+      packed_field->set_datatype(field.second == 20 ? ignition::msgs::PointCloudPacked::Field::UINT16
+                                                    : ignition::msgs::PointCloudPacked::Field::FLOAT32);
+      packed_field->set_count(1);
+    }
+    cloud.set_width(width);
+    cloud.set_height(height);
+    cloud.set_point_step(32);
+    cloud.set_row_step(32 * width);
+    cloud.set_is_dense(true);
+    cloud.mutable_data()->resize(32 * width * height, '\x01');
+    return cloud;
+  }
+
+  ignition::msgs::LaserScan syntheticScan(int64_t count, int64_t vertical_count)
+  {
+    ignition::msgs::LaserScan scan;
+    stamp(scan.mutable_header(), 0, kModel + "::lidar::lidar_link::lidar");
+    scan.set_frame(kModel + "::lidar");
+    scan.set_count(count);
+    scan.set_angle_min(-M_PI);
+    scan.set_angle_max(M_PI);
+    scan.set_angle_step(2.0 * M_PI / count);
+    scan.set_vertical_count(vertical_count);
+    scan.set_vertical_angle_min(-0.26);
+    scan.set_vertical_angle_max(0.26);
+    scan.set_vertical_angle_step(vertical_count > 1 ? 0.52 / (vertical_count - 1) : 0.0);
+    scan.set_range_min(0.1);
+    scan.set_range_max(100.0);
+    scan.mutable_ranges()->Resize(count * vertical_count, 7.5);
+    scan.mutable_intensities()->Resize(count * vertical_count, 1.0);
+    return scan;
+  }
+
+  ignition::msgs::IMU syntheticImu()
+  {
+    ignition::msgs::IMU imu;
+    stamp(imu.mutable_header(), 0, kModel + "::imu::imu_link::imu");
+    imu.mutable_orientation()->set_w(1.0);
+    imu.mutable_linear_acceleration()->set_z(9.81);
+    return imu;
+  }
+
+  ignition::msgs::NavSat syntheticNavSat()
+  {
+    ignition::msgs::NavSat navsat;
+    stamp(navsat.mutable_header(), 0, kModel + "::gps::gps_link::gps");
+    navsat.set_frame_id(kModel + "::gps::gps_link::gps");
+    navsat.set_latitude_deg(40.4);
+    navsat.set_longitude_deg(-3.7);
+    navsat.set_altitude(650.0);
+    return navsat;
+  }
+
+  // Counted around the work of each iteration, since the benchmark loop allocates on its own
+  template <typename Work>
+  void countAllocations(AllocationCount & total, Work && work)
+  {
+    AllocationScope scope;
+    work();
+    const AllocationCount count = scope.count();
+    total.allocations += count.allocations;
+    total.bytes += count.bytes;
+  }
+
+  void reportCounters(benchmark::State & state, const AllocationCount & allocations, size_t bytes_copied)
+  {
+    state.counters["allocs_per_msg"] =
+      benchmark::Counter(static_cast<double>(allocations.allocations), benchmark::Counter::kAvgIterations);
+    state.counters["alloc_bytes_per_msg"] =
+      benchmark::Counter(static_cast<double>(allocations.bytes), benchmark::Counter::kAvgIterations);
+    state.counters["bytes_copied_per_msg"] =
+      benchmark::Counter(static_cast<double>(bytes_copied), benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(static_cast<int64_t>(bytes_copied));
+  }
+
+  // The channel of the stream with a platform callback that only counts what it was handed
+  template <typename IgnMsgT>
+  void channelBenchmark(benchmark::State & state, const IgnMsgT & msg)
+  {
+    using RosMsgT = typename ignition_platform::SensorStream<IgnMsgT>::RosMsg;
+    size_t bytes_copied = 0;
+    auto channel = makeSensorChannel<IgnMsgT>(
+      [&bytes_copied](RosMsgT & ros_msg) { bytes_copied += copiedBytes(ros_msg); },
+      std::make_shared<SensorStats>());
+
+    // Steady state, with the buffers of the channel already sized
+    (*channel)(msg);
+    bytes_copied = 0;
+    AllocationCount allocations;
+    for (auto _ : state)
+    {
+      countAllocations(allocations, [&]() { (*channel)(msg); });
+    }
+    reportCounters(state, allocations, bytes_copied);
+  }
+
+  // Ignition delivers in-process messages from the publishing thread, but the wait keeps the
+  // figures meaningful should a message be handed to another thread
+  void waitDelivered(const std::atomic<uint64_t> & delivered, uint64_t expected)
+  {
+    while (delivered.load(std::memory_order_acquire) < expected)
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static void BM_Image(benchmark::State & state)
+{
+  channelBenchmark(state, syntheticImage(state.range(0), state.range(1)));
+}
+BENCHMARK(BM_Image)->Args({640, 480})->Args({1920, 1080})->Args({3840, 2160});
+
+static void BM_PointCloudPacked(benchmark::State & state)
+{
+  channelBenchmark(state, syntheticCloud(state.range(0), state.range(1)));
+}
+BENCHMARK(BM_PointCloudPacked)->Args({1024, 16})->Args({2048, 128});
+
+static void BM_LaserScan(benchmark::State & state)
+{
+  channelBenchmark(state, syntheticScan(state.range(0), state.range(1)));
+}
+BENCHMARK(BM_LaserScan)->Args({1024, 1})->Args({2048, 128});
+
+static void BM_Imu(benchmark::State & state)
+{
+  channelBenchmark(state, syntheticImu());
+}
+BENCHMARK(BM_Imu);
+
+static void BM_NavSat(benchmark::State & state)
+{
+  channelBenchmark(state, syntheticNavSat());
+}
+BENCHMARK(BM_NavSat);
+
+static void BM_Odometry(benchmark::State & state)
+{
+  ignition_platform::IgnitionBridge bridge("/" + kModel);
+  std::atomic<uint64_t> delivered{0};
+  size_t bytes_copied = 0;
+  bridge.setOdometryCallback(
+    [&](nav_msgs::msg::Odometry & msg)
+    {
+      bytes_copied += copiedBytes(msg);
+      delivered.fetch_add(1, std::memory_order_release);
+    });
+
+  ignition::transport::Node node;
+  auto publisher = node.Advertise<ignition::msgs::Odometry>("model/" + kModel + "/odometry");
+  ignition::msgs::Odometry odometry;
+  stamp(odometry.mutable_header(), 0, kModel + "/odom");
+  auto * child_frame = odometry.mutable_header()->add_data();
+  child_frame->set_key("child_frame_id");
+  child_frame->add_value(kModel);
+  odometry.mutable_pose()->mutable_orientation()->set_w(1.0);
+  odometry.mutable_twist()->mutable_linear()->set_x(1.0);
+
+  uint64_t published = 0;
+  publisher.Publish(odometry);
+  waitDelivered(delivered, ++published);
+  bytes_copied = 0;
+  AllocationCount allocations;
+  for (auto _ : state)
+  {
+    countAllocations(allocations, [&]() { publisher.Publish(odometry); });
+    waitDelivered(delivered, ++published);
+  }
+  reportCounters(state, allocations, bytes_copied);
+}
+BENCHMARK(BM_Odometry)->UseRealTime();
+
+// IMU on the base link through an IgnitionBridge. Besides the time per message it reports the p99
+// conversion and dispatch times the bridge keeps for /diagnostics, whose sum has to stay under the
+// 1 ms period of a 1 kHz IMU: fits_1khz is 1 when it does.
+static void BM_ImuThroughBridge(benchmark::State & state)
+{
+  ignition_platform::IgnitionBridge bridge("/" + kModel);
+  std::atomic<uint64_t> delivered{0};
+  bridge.setImuCallback(
+    [&delivered](sensor_msgs::msg::Imu &) { delivered.fetch_add(1, std::memory_order_release); }, kWorld);
+
+  ignition::transport::Node node;
+  auto publisher = node.Advertise<ignition::msgs::IMU>(
+    "world/" + kWorld + "/model/" + kModel + "/link/base_link/sensor/imu_sensor" +
+    ignition_platform::SensorStream<ignition::msgs::IMU>::suffix);
+  const ignition::msgs::IMU imu = syntheticImu();
+
+  uint64_t published = 0;
+  for (auto _ : state)
+  {
+    publisher.Publish(imu);
+    waitDelivered(delivered, ++published);
+  }
+  const auto & stats = *bridge.getSensorStats().at("imu");
+  const uint64_t conversion_p99 = stats.conversion_time.percentile(99.0);
+  const uint64_t dispatch_p99 = stats.dispatch_time.percentile(99.0);
+  state.counters["conversion_p99_ns"] = static_cast<double>(conversion_p99);
+  state.counters["dispatch_p99_ns"] = static_cast<double>(dispatch_p99);
+  state.counters["fits_1khz"] = conversion_p99 + dispatch_p99 < 1000000 ? 1.0 : 0.0;
+}
+BENCHMARK(BM_ImuThroughBridge)->UseRealTime();
+
+// pose_static of a model with sensors on some of its links. With moving:=0 the poses repeat, which
+// is the steady state, and with moving:=1 every pose changes on every message.
+static void BM_PoseV(benchmark::State & state)
+{
+  const int64_t links = state.range(0);
+  const bool moving = state.range(1) != 0;
+  constexpr int64_t kSensors = 4;
+
+  ignition_platform::IgnitionBridge bridge("/" + kModel);
+  size_t bytes_copied = 0;
+  uint64_t transforms = 0;
+  for (int64_t i = 0; i < kSensors; i++)
+  {
+    bridge.addSensor<ignition::msgs::IMU>(
+      kWorld, kModel, "sensor" + std::to_string(i), "sensor" + std::to_string(i) + "_link", "imu",
+      [](sensor_msgs::msg::Imu &) {},
+      [&](geometry_msgs::msg::TransformStamped & msg, const std::string &)
+      {
+        bytes_copied += copiedBytes(msg);
+        transforms++;
+      });
+  }
+
+  ignition::msgs::Pose_V poses;
+  for (int64_t i = 0; i < links; i++)
+  {
+    const std::string child = i < kSensors ? "sensor" + std::to_string(i) : "link" + std::to_string(i);
+    auto * pose = poses.add_pose();
+    pose->set_name(kModel + "/" + child);
+    stamp(pose->mutable_header(), 0, kModel);
+    auto * child_frame = pose->mutable_header()->add_data();
+    child_frame->set_key("child_frame_id");
+    child_frame->add_value(kModel + "/" + child);
+    pose->mutable_position()->set_x(0.1 * i);
+    pose->mutable_orientation()->set_w(1.0);
+  }
+
+  // pose_static has no stats of its own, so completion is told by a message on another topic
+  // published right after it by the same thread
+  std::atomic<uint64_t> delivered{0};
+  bridge.setOdometryCallback([&delivered](nav_msgs::msg::Odometry &)
+                             { delivered.fetch_add(1, std::memory_order_release); });
+  ignition::transport::Node node;
+  auto publisher = node.Advertise<ignition::msgs::Pose_V>("model/" + kModel + "/pose_static");
+  auto marker = node.Advertise<ignition::msgs::Odometry>("model/" + kModel + "/odometry");
+  const ignition::msgs::Odometry marker_msg;
+
+  uint64_t published = 0;
+  publisher.Publish(poses);
+  marker.Publish(marker_msg);
+  waitDelivered(delivered, ++published);
+  bytes_copied = 0;
+  transforms = 0;
+  AllocationCount allocations;
+  for (auto _ : state)
+  {
+    if (moving)
+    {
+      for (auto & pose : *poses.mutable_pose())
+      {
+        pose.mutable_position()->set_z(static_cast<double>(published));
+      }
+    }
+    countAllocations(allocations, [&]() { publisher.Publish(poses); });
+    marker.Publish(marker_msg);
+    waitDelivered(delivered, ++published);
+  }
+  reportCounters(state, allocations, bytes_copied);
+  state.counters["transforms_per_msg"] =
+    benchmark::Counter(static_cast<double>(transforms), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_PoseV)->Args({16, 0})->Args({16, 1})->Args({64, 0})->UseRealTime();
+
+// Image kernels on a 1920x1080 rgb8 frame, in pixels per second
+namespace
+{
+  constexpr size_t kKernelWidth = 1920;
+  constexpr size_t kKernelHeight = 1080;
+
+  void swapRedBlueReference(const uint8_t * src, uint8_t * dst, size_t pixels)
+  {
+    for (size_t i = 0; i < pixels; i++)
+    {
+      dst[3 * i] = src[3 * i + 2];
+      dst[3 * i + 1] = src[3 * i + 1];
+      dst[3 * i + 2] = src[3 * i];
+    }
+  }
+
+  void rgbToMonoReference(const uint8_t * src, uint8_t * dst, size_t pixels)
+  {
+    for (size_t i = 0; i < pixels; i++)
+    {
+      dst[i] = static_cast<uint8_t>((77 * src[3 * i] + 150 * src[3 * i + 1] + 29 * src[3 * i + 2] + 128) >> 8);
+    }
+  }
+
+  void downscale2xReference(const uint8_t * src, size_t src_step, uint8_t * dst, size_t dst_step,
+                            size_t width, size_t height, size_t channels)
+  {
+    for (size_t y = 0; y + 1 < height; y += 2)
+    {
+      for (size_t x = 0; x + 1 < width; x += 2)
+      {
+        for (size_t c = 0; c < channels; c++)
+        {
+          auto pixel = [&](size_t row, size_t column) { return src[row * src_step + column * channels + c]; };
+          const int left = (pixel(y, x) + pixel(y + 1, x) + 1) >> 1;
+          const int right = (pixel(y, x + 1) + pixel(y + 1, x + 1) + 1) >> 1;
+          dst[(y / 2) * dst_step + (x / 2) * channels + c] = static_cast<uint8_t>((left + right + 1) >> 1);
+        }
+      }
+    }
+  }
+
+  std::vector<uint8_t> kernelSource()
+  {
+    std::vector<uint8_t> source(kKernelWidth * kKernelHeight * 3);
+    for (size_t i = 0; i < source.size(); i++)
+    {
+      source[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+    }
+    return source;
+  }
+
+  // Runs the kernel on the frame, dispatched with simd:=1 and as the scalar reference otherwise
+  template <typename Kernel, typename Reference>
+  void kernelBenchmark(benchmark::State & state, size_t output_bytes, Kernel kernel, Reference reference)
+  {
+    const bool simd = state.range(0) != 0;
+    const std::vector<uint8_t> source = kernelSource();
+    std::vector<uint8_t> output(output_bytes);
+    std::vector<uint8_t> expected(output_bytes);
+    kernel(source.data(), output.data());
+    reference(source.data(), expected.data());
+    if (output != expected)
+    {
+      state.SkipWithError("dispatched kernel output differs from the scalar reference");
+      return;
+    }
+
+    for (auto _ : state)
+    {
+      if (simd)
+      {
+        kernel(source.data(), output.data());
+      }
+      else
+      {
+        reference(source.data(), output.data());
+      }
+      benchmark::DoNotOptimize(output.data());
+      benchmark::ClobberMemory();
+    }
+    state.SetLabel(simd ? ignition_platform::image_kernels::instructionSet() : "scalar");
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kKernelWidth * kKernelHeight));
+  }
+}
+
+static void BM_SwapRedBlue(benchmark::State & state)
+{
+  kernelBenchmark(
+    state, kKernelWidth * kKernelHeight * 3,
+    [](const uint8_t * src, uint8_t * dst)
+    { ignition_platform::image_kernels::swapRedBlue(src, dst, kKernelWidth * kKernelHeight); },
+    [](const uint8_t * src, uint8_t * dst) { swapRedBlueReference(src, dst, kKernelWidth * kKernelHeight); });
+}
+BENCHMARK(BM_SwapRedBlue)->Arg(0)->Arg(1);
+
+static void BM_RgbToMono(benchmark::State & state)
+{
+  kernelBenchmark(
+    state, kKernelWidth * kKernelHeight,
+    [](const uint8_t * src, uint8_t * dst)
+    { ignition_platform::image_kernels::rgbToMono(src, dst, kKernelWidth * kKernelHeight); },
+    [](const uint8_t * src, uint8_t * dst) { rgbToMonoReference(src, dst, kKernelWidth * kKernelHeight); });
+}
+BENCHMARK(BM_RgbToMono)->Arg(0)->Arg(1);
+
+static void BM_Downscale2x(benchmark::State & state)
+{
+  kernelBenchmark(
+    state, (kKernelWidth / 2) * (kKernelHeight / 2) * 3,
+    [](const uint8_t * src, uint8_t * dst)
+    {
+      ignition_platform::image_kernels::downscale2x(src, kKernelWidth * 3, dst, (kKernelWidth / 2) * 3,
+                                                    kKernelWidth, kKernelHeight, 3);
+    },
+    [](const uint8_t * src, uint8_t * dst)
+    { downscale2xReference(src, kKernelWidth * 3, dst, (kKernelWidth / 2) * 3, kKernelWidth, kKernelHeight, 3); });
+}
+BENCHMARK(BM_Downscale2x)->Arg(0)->Arg(1);
+
+// The whole camera pipeline: bgr8 conversion of the frame and two pyramid levels
+static void BM_ImagePipeline(benchmark::State & state)
+{
+  ignition_platform::ImagePipelineOptions options;
+  options.encoding = sensor_msgs::image_encodings::BGR8;
+  options.pyramid_levels = 2;
+  ignition_platform::ImagePipeline pipeline(options);
+
+  sensor_msgs::msg::Image frame;
+  frame.width = kKernelWidth;
+  frame.height = kKernelHeight;
+  frame.encoding = sensor_msgs::image_encodings::RGB8;
+  frame.step = kKernelWidth * 3;
+  frame.data = kernelSource();
+
+  pipeline.process(frame);
+  AllocationCount allocations;
+  for (auto _ : state)
+  {
+    countAllocations(allocations, [&]() { benchmark::DoNotOptimize(pipeline.process(frame)); });
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kKernelWidth * kKernelHeight));
+  state.counters["allocs_per_msg"] =
+    benchmark::Counter(static_cast<double>(allocations.allocations), benchmark::Counter::kAvgIterations);
+  state.SetLabel(ignition_platform::image_kernels::instructionSet());
+}
+BENCHMARK(BM_ImagePipeline);
+
+// Point cloud filters on a 128 x 2048 lidar sweep of 20 byte points, a few of them missing
+namespace
+{
+  sensor_msgs::msg::PointCloud2 syntheticSweep()
+  {
+    constexpr int kBeams = 128;
+    constexpr int kColumns = 2048;
+    sensor_msgs::msg::PointCloud2 cloud;
+    for (const char * name : {"x", "y", "z", "intensity", "ring"})
+    {
+      sensor_msgs::msg::PointField field;
+      field.name = name;
+      field.offset = static_cast<uint32_t>(4 * cloud.fields.size());
+      field.datatype = sensor_msgs::msg::PointField::FLOAT32;
+      field.count = 1;
+      cloud.fields.push_back(field);
+    }
+    cloud.height = 1;
+    cloud.width = kBeams * kColumns;
+    cloud.point_step = 20;
+    cloud.row_step = cloud.width * cloud.point_step;
+    cloud.data.resize(cloud.row_step);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(0.0f, 0.5f);
+    for (int i = 0; i < kBeams * kColumns; i++)
+    {
+      const int column = i % kColumns;
+      const float range = i % 37 == 0 ? INFINITY : 8.0f + 4.0f * std::sin(column * 0.003f) + noise(rng);
+      const float azimuth = static_cast<float>(column * 2.0 * M_PI / kColumns);
+      const float elevation = static_cast<float>((i / kColumns - kBeams / 2) * 0.35 * M_PI / 180.0);
+      const float point[5] = {range * std::cos(elevation) * std::cos(azimuth),
+                              range * std::cos(elevation) * std::sin(azimuth), range * std::sin(elevation), 1.0f,
+                              static_cast<float>(i / kColumns)};
+      std::memcpy(&cloud.data[i * cloud.point_step], point, sizeof(point));
+    }
+    return cloud;
+  }
+
+  size_t distinctVoxels(const sensor_msgs::msg::PointCloud2 & cloud, double leaf_size)
+  {
+    const float inverse_leaf_size = static_cast<float>(1.0 / leaf_size);
+    std::set<std::tuple<int64_t, int64_t, int64_t>> voxels;
+    for (size_t i = 0; i < cloud.width; i++)
+    {
+      float point[3];
+      std::memcpy(point, &cloud.data[i * cloud.point_step], sizeof(point));
+      if (std::isfinite(point[0]) && std::isfinite(point[1]) && std::isfinite(point[2]))
+      {
+        voxels.emplace(static_cast<int64_t>(std::floor(point[0] * inverse_leaf_size)),
+                       static_cast<int64_t>(std::floor(point[1] * inverse_leaf_size)),
+                       static_cast<int64_t>(std::floor(point[2] * inverse_leaf_size)));
+      }
+    }
+    return voxels.size();
+  }
+
+  void filterBenchmark(benchmark::State & state, const ignition_platform::PointCloudFilterOptions & options)
+  {
+    const sensor_msgs::msg::PointCloud2 cloud = syntheticSweep();
+    ignition_platform::PointCloudFilter filter(options);
+    const sensor_msgs::msg::PointCloud2 * output = &filter.apply(cloud);
+    if (options.type == "voxel" && output->width != distinctVoxels(cloud, options.leaf_size))
+    {
+      state.SkipWithError("voxel filter output differs from the number of distinct voxels");
+      return;
+    }
+
+    AllocationCount allocations;
+    for (auto _ : state)
+    {
+      countAllocations(allocations, [&]() { output = &filter.apply(cloud); });
+      benchmark::DoNotOptimize(output->data.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * cloud.width));
+    state.counters["points_out"] = output->width;
+    state.counters["bytes_out"] = static_cast<double>(output->data.size());
+    state.counters["allocs_per_msg"] =
+      benchmark::Counter(static_cast<double>(allocations.allocations), benchmark::Counter::kAvgIterations);
+  }
+}
+
+// Leaf size in millimeters
+static void BM_VoxelFilter(benchmark::State & state)
+{
+  ignition_platform::PointCloudFilterOptions options;
+  options.type = "voxel";
+  options.leaf_size = state.range(0) / 1000.0;
+  filterBenchmark(state, options);
+}
+BENCHMARK(BM_VoxelFilter)->Arg(50)->Arg(100)->Arg(200)->Arg(500);
+
+// Kept fraction in percent
+static void BM_RandomFilter(benchmark::State & state)
+{
+  ignition_platform::PointCloudFilterOptions options;
+  options.type = "random";
+  options.keep_ratio = state.range(0) / 100.0;
+  filterBenchmark(state, options);
+}
+BENCHMARK(BM_RandomFilter)->Arg(10);
+
+// Organized cloud of a lidar projected from its scan, in points per second
+static void BM_ScanProjector(benchmark::State & state)
+{
+  ignition::msgs::LaserScan scan = syntheticScan(state.range(0), state.range(1));
+  for (int i = 0; i < scan.ranges_size(); i++)
+  {
+    scan.set_ranges(i, 1.0 + (i % 97) * 0.25);
+  }
+  ignition_platform::ScanProjector projector;
+  sensor_msgs::msg::PointCloud2 cloud;
+  projector.project(scan, cloud);
+
+  double max_error = 0.0;
+  for (int64_t ring = 0; ring < state.range(1); ring++)
+  {
+    const double inclination = scan.vertical_angle_min() + ring * scan.vertical_angle_step();
+    for (int64_t column = 0; column < state.range(0); column++)
+    {
+      const size_t index = static_cast<size_t>(ring * state.range(0) + column);
+      const double azimuth = scan.angle_min() + column * scan.angle_step();
+      const double expected[3] = {scan.ranges(index) * std::cos(inclination) * std::cos(azimuth),
+                                  scan.ranges(index) * std::cos(inclination) * std::sin(azimuth),
+                                  scan.ranges(index) * std::sin(inclination)};
+      float point[3];
+      std::memcpy(point, &cloud.data[index * cloud.point_step], sizeof(point));
+      for (int k = 0; k < 3; k++)
+      {
+        max_error = std::max(max_error, std::fabs(point[k] - expected[k]));
+      }
+    }
+  }
+  if (max_error > 1e-4)
+  {
+    state.SkipWithError("projected points differ from the double precision projection");
+    return;
+  }
+
+  AllocationCount allocations;
+  for (auto _ : state)
+  {
+    countAllocations(allocations, [&]() { projector.project(scan, cloud); });
+    benchmark::DoNotOptimize(cloud.data.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * scan.ranges_size()));
+  state.counters["max_error_m"] = max_error;
+  state.counters["allocs_per_msg"] =
+    benchmark::Counter(static_cast<double>(allocations.allocations), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ScanProjector)->Args({1024, 16})->Args({2048, 128});
+
+namespace
+{
+  // Segments smaller than the default, so that the figures include segment rollover
+  template <typename IgnMsgT>
+  void recorderBenchmark(benchmark::State & state, const IgnMsgT & msg)
+  {
+    const std::string path = (std::filesystem::temp_directory_path() /
+                              ("ignition_platform_benchmark_" + std::to_string(getpid()))).string();
+    {
+      ignition_platform::StreamRecorder recorder(path, static_cast<size_t>(64) << 20);
+      const uint16_t topic_id = recorder.addTopic("/benchmark", msg.GetTypeName());
+      AllocationCount allocations;
+      for (auto _ : state)
+      {
+        countAllocations(allocations, [&]() { recorder.record(topic_id, msg); });
+      }
+      if (recorder.dropped.load() > 0)
+      {
+        state.SkipWithError("messages were dropped by the recorder");
+      }
+      state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * msg.ByteSizeLong()));
+      state.counters["allocs_per_msg"] =
+        benchmark::Counter(static_cast<double>(allocations.allocations), benchmark::Counter::kAvgIterations);
+    }
+    for (size_t index = 0; std::filesystem::remove(path + "." + std::to_string(index)); index++)
+    {
+    }
+  }
+}
+
+// Raw ignition messages appended to a recording, as the bridge does for every message it receives
+// while record_path is set
+static void BM_StreamRecorderImu(benchmark::State & state)
+{
+  recorderBenchmark(state, syntheticImu());
+}
+BENCHMARK(BM_StreamRecorderImu);
+
+static void BM_StreamRecorderImage(benchmark::State & state)
+{
+  recorderBenchmark(state, syntheticImage(state.range(0), state.range(1)));
+}
+BENCHMARK(BM_StreamRecorderImage)->Args({640, 480});
+
+// Odometry at 200 Hz handled on the thread that also hands two 30 Hz 4K cameras to a worker pool
+// of the given number of threads, as the ignition transport thread does. With 0 threads the frames
+// are converted inline. Reports the delay of the odometry ticks, which is what the cameras cost
+// the inline streams, and how many frames were converted.
+static void BM_OdometryUnderCameraLoad(benchmark::State & state)
+{
+  using Clock = std::chrono::steady_clock;
+  constexpr int kCameras = 2;
+  constexpr auto kDuration = std::chrono::seconds(5);
+  constexpr auto kOdometryPeriod = std::chrono::milliseconds(5);
+  constexpr auto kFramePeriod = std::chrono::microseconds(33333);
+
+  // Declared before the pool, whose workers may still be converting until it is gone
+  std::atomic<uint64_t> converted{0};
+  ignition_platform::WorkerPool pool(static_cast<size_t>(state.range(0)));
+  std::vector<std::shared_ptr<ignition_platform::Strand<ignition::msgs::Image>>> strands;
+  for (int i = 0; i < kCameras; i++)
+  {
+    auto channel = makeSensorChannel<ignition::msgs::Image>(
+      [&converted](sensor_msgs::msg::Image &) { converted.fetch_add(1, std::memory_order_relaxed); },
+      std::make_shared<SensorStats>());
+    strands.emplace_back(std::make_shared<ignition_platform::Strand<ignition::msgs::Image>>(
+      pool, 1, [channel](const ignition::msgs::Image & msg) { channel->convert(msg); }));
+  }
+  const ignition::msgs::Image image = syntheticImage(3840, 2160);
+
+  std::vector<double> delays_ms;
+  for (auto _ : state)
+  {
+    const auto start = Clock::now();
+    auto next_odometry = start;
+    auto next_frame = start;
+    while (Clock::now() - start < kDuration)
+    {
+      const auto now = Clock::now();
+      if (now >= next_odometry)
+      {
+        delays_ms.push_back(std::chrono::duration<double, std::milli>(now - next_odometry).count());
+        next_odometry = std::max(next_odometry + kOdometryPeriod, now);
+      }
+      if (now >= next_frame)
+      {
+        for (auto & strand : strands)
+        {
+          strand->push(image);
+        }
+        next_frame += kFramePeriod;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  std::sort(delays_ms.begin(), delays_ms.end());
+  state.counters["odom_delay_p50_ms"] = delays_ms[delays_ms.size() / 2];
+  state.counters["odom_delay_p99_ms"] = delays_ms[delays_ms.size() * 99 / 100];
+  state.counters["odom_delay_max_ms"] = delays_ms.back();
+  state.counters["frames_converted"] = static_cast<double>(converted.load());
+}
+BENCHMARK(BM_OdometryUnderCameraLoad)->Arg(0)->Arg(1)->Arg(2)->Iterations(1)->UseRealTime()->Unit(benchmark::kSecond);
+
+// Exact-stamp bundle of a stereo pair of the given size with the IMU samples between two frames as
+// its window, one bundle per iteration. The frames are copied into the rings of the bundle, which
+// is most of the cost. Every message fed has to be released exactly once.
+static void BM_SensorBundle(benchmark::State & state)
+{
+  constexpr int64_t kImuPerFrame = 33;
+  constexpr int64_t kImuPeriodNs = 1000000;
+  auto bundle = std::make_shared<ignition_platform::SensorBundle>(
+    "stereo", std::vector<std::string>{"left", "right"}, std::vector<std::string>{"imu"}, 4, 2 * kImuPerFrame);
+  uint64_t released = 0;
+  const auto count = [&released](const auto &) { released++; };
+  auto left = bundle->addMember<sensor_msgs::msg::Image>("left", count);
+  auto right = bundle->addMember<sensor_msgs::msg::Image>("right", count);
+  auto imu = bundle->addMember<sensor_msgs::msg::Imu>("imu", count);
+
+  sensor_msgs::msg::Image image;
+  ignition_platform::SensorStream<ignition::msgs::Image>::convert(syntheticImage(state.range(0), state.range(1)), image);
+  sensor_msgs::msg::Imu imu_msg;
+  ignition_platform::SensorStream<ignition::msgs::IMU>::convert(syntheticImu(), imu_msg);
+  int64_t stamp_ns = 0;
+  const auto setStamp = [&stamp_ns](std_msgs::msg::Header & header)
+  {
+    header.stamp.sec = static_cast<int32_t>(stamp_ns / 1000000000);
+    header.stamp.nanosec = static_cast<uint32_t>(stamp_ns % 1000000000);
+  };
+  const auto feedBundle = [&]()
+  {
+    for (int64_t i = 0; i < kImuPerFrame; i++)
+    {
+      stamp_ns += kImuPeriodNs;
+      setStamp(imu_msg.header);
+      imu(imu_msg);
+    }
+    setStamp(image.header);
+    left(image);
+    right(image);
+  };
+
+  // Steady state, with the rings already holding frames of this size
+  for (int i = 0; i < 8; i++)
+  {
+    feedBundle();
+  }
+  released = 0;
+  AllocationCount allocations;
+  for (auto _ : state)
+  {
+    countAllocations(allocations, feedBundle);
+  }
+  if (released != static_cast<uint64_t>(state.iterations() * (kImuPerFrame + 2)))
+  {
+    state.SkipWithError("the bundle did not release every message once");
+    return;
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * 2 * image.data.size()));
+  state.counters["allocs_per_bundle"] =
+    benchmark::Counter(static_cast<double>(allocations.allocations), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_SensorBundle)->Args({640, 480})->Args({1920, 1080});
+
+BENCHMARK_MAIN();
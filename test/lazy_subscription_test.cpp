@@ -0,0 +1,156 @@
+/*!*******************************************************************************************
+ *  \file       lazy_subscription_test.cpp
+ *  \brief      Camera subscription following its demand
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// A 4K camera published on an in-process ignition node at 30 Hz is neither received nor converted
+// by the bridge while it has no demand, and is again as soon as it has. The CPU time of each phase
+// is recorded as a property but not compared: it is that of the whole process, including the
+// ignition discovery threads, and too noisy to assert on.
+
+#include <gtest/gtest.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "ignition_bridge.hpp"
+
+namespace
+{
+  const std::string kWorld = "lazy";
+  const std::string kModel = "drone0";
+  const std::string kCamera = "camera";
+  constexpr int kFrames = 30;
+
+  double cpuSeconds()
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           1e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+  }
+
+  ignition::msgs::Image syntheticImage(uint32_t width, uint32_t height)
+  {
+    ignition::msgs::Image image;
+    image.set_width(width);
+    image.set_height(height);
+    image.set_step(width * 3);
+    image.set_pixel_format_type(ignition::msgs::PixelFormatType::RGB_INT8);
+    image.mutable_data()->resize(static_cast<size_t>(width) * height * 3, '\x40');
+    return image;
+  }
+
+  class LazySubscriptionTest : public ::testing::Test
+  {
+  protected:
+    LazySubscriptionTest()
+    : bridge_("/" + kModel), image_(syntheticImage(3840, 2160))
+    {
+      bridge_.addSensor(
+        kWorld, kModel, kCamera, "camera_link", "camera",
+        [this](sensor_msgs::msg::Image &) { converted_++; }, [](sensor_msgs::msg::CameraInfo &) {},
+        [](geometry_msgs::msg::TransformStamped &, const std::string &) {});
+      image_pub_ = publisher_node_.Advertise<ignition::msgs::Image>(
+        "/world/" + kWorld + "/model/" + kModel + "/model/" + kCamera + "/link/camera_link/sensor/camera" +
+        ignition_platform::SensorStream<ignition::msgs::Image>::suffix);
+    }
+
+    // CPU seconds taken by the process to publish kFrames at 30 Hz and to convert them if wanted
+    double publishFrames()
+    {
+      const uint64_t expected = converted_.load() + kFrames;
+      const double start = cpuSeconds();
+      auto next = std::chrono::steady_clock::now();
+      for (int i = 0; i < kFrames; i++)
+      {
+        image_.mutable_header()->mutable_stamp()->set_nsec(i * 33333333);
+        image_pub_.Publish(image_);
+        next += std::chrono::milliseconds(33);
+        std::this_thread::sleep_until(next);
+      }
+      // Frames being converted are waited for, unless none was
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while (converted_.load() < expected && converted_.load() > expected - kFrames &&
+             std::chrono::steady_clock::now() < deadline)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return cpuSeconds() - start;
+    }
+
+    const ignition_platform::SensorStats & stats()
+    {
+      return *bridge_.getSensorStats().at(kCamera);
+    }
+
+    // Declared first, the conversion workers of the bridge may use it until the bridge is gone
+    std::atomic<uint64_t> converted_{0};
+    ignition_platform::IgnitionBridge bridge_;
+    ignition::transport::Node publisher_node_;
+    ignition::transport::Node::Publisher image_pub_;
+    ignition::msgs::Image image_;
+  };
+}
+
+TEST_F(LazySubscriptionTest, UnobservedCameraIsNotSubscribed)
+{
+  publishFrames();
+  EXPECT_EQ(stats().received.load(), 0u);
+  EXPECT_EQ(converted_.load(), 0u);
+}
+
+TEST_F(LazySubscriptionTest, DemandStartsAndStopsConversion)
+{
+  const double unobserved = publishFrames();
+
+  ASSERT_TRUE(bridge_.setSensorDemand(kCamera, true));
+  const double observed = publishFrames();
+  EXPECT_EQ(stats().received.load(), static_cast<uint64_t>(kFrames));
+  EXPECT_GT(converted_.load(), 0u);
+
+  // Dropping the demand unsubscribes again
+  ASSERT_TRUE(bridge_.setSensorDemand(kCamera, false));
+  const uint64_t converted = converted_.load();
+  const double dropped = publishFrames();
+  EXPECT_EQ(stats().received.load(), static_cast<uint64_t>(kFrames));
+  EXPECT_EQ(converted_.load(), converted);
+
+  ::testing::Test::RecordProperty("cpu_us_per_frame_unobserved", static_cast<int>(1e6 * unobserved / kFrames));
+  ::testing::Test::RecordProperty("cpu_us_per_frame_observed", static_cast<int>(1e6 * observed / kFrames));
+  ::testing::Test::RecordProperty("cpu_us_per_frame_dropped", static_cast<int>(1e6 * dropped / kFrames));
+}
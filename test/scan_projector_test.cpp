@@ -0,0 +1,218 @@
+/*!*******************************************************************************************
+ *  \file       scan_projector_test.cpp
+ *  \brief      Scan projection against the simulator point cloud
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// The cloud projected from a scan has to be the one the simulator would have published on
+// /scan/points, so that lidar_points_from_scan can be switched on without subscribers noticing.
+// The reference cloud is built from the same scan the way the gpu_lidar sensor fills its
+// PointCloudPacked, in double precision, and goes through the bridge conversion to PointCloud2.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "scan_projector.hpp"
+#include "sensor_channel.hpp"
+
+namespace
+{
+  constexpr uint32_t kColumns = 512;
+  constexpr uint32_t kRings = 16;
+
+  ignition::msgs::LaserScan syntheticScan()
+  {
+    ignition::msgs::LaserScan scan;
+    scan.mutable_header()->mutable_stamp()->set_sec(3);
+    scan.set_count(kColumns);
+    scan.set_angle_min(-M_PI);
+    scan.set_angle_max(M_PI);
+    scan.set_angle_step(2.0 * M_PI / kColumns);
+    scan.set_vertical_count(kRings);
+    scan.set_vertical_angle_min(-0.26);
+    scan.set_vertical_angle_max(0.26);
+    scan.set_vertical_angle_step(0.52 / (kRings - 1));
+    scan.set_range_min(0.1);
+    scan.set_range_max(50.0);
+    for (uint32_t i = 0; i < kColumns * kRings; i++)
+    {
+      // Some rays without a return
+      scan.add_ranges(i % 13 == 0 ? std::numeric_limits<double>::infinity() : 1.0 + (i % 97) * 0.25);
+      scan.add_intensities(static_cast<double>(i % 7));
+    }
+    return scan;
+  }
+
+  // x, y, z, intensity and ring in 32 byte points, row major by ring
+  ignition::msgs::PointCloudPacked gazeboCloud(const ignition::msgs::LaserScan & scan)
+  {
+    ignition::msgs::PointCloudPacked cloud;
+    *cloud.mutable_header() = scan.header();
+    const std::pair<const char *, uint32_t> fields[] = {
+      {"x", 0}, {"y", 4}, {"z", 8}, {"intensity", 16}, {"ring", 20}};
+    for (const auto & field : fields)
+    {
+      auto * packed_field = cloud.add_field();
+      packed_field->set_name(field.first);
+      packed_field->set_offset(field.second);
+      packed_field->set_datatype(field.second == 20 ? ignition::msgs::PointCloudPacked::Field::UINT16
+                                                    : ignition::msgs::PointCloudPacked::Field::FLOAT32);
+      packed_field->set_count(1);
+    }
+    cloud.set_width(scan.count());
+    cloud.set_height(scan.vertical_count());
+    cloud.set_point_step(32);
+    cloud.set_row_step(32 * scan.count());
+    cloud.set_is_dense(false);
+
+    std::string * data = cloud.mutable_data();
+    data->assign(static_cast<size_t>(32) * scan.count() * scan.vertical_count(), '\0');
+    for (uint32_t ring = 0; ring < scan.vertical_count(); ring++)
+    {
+      const double inclination = scan.vertical_angle_min() + ring * scan.vertical_angle_step();
+      for (uint32_t column = 0; column < scan.count(); column++)
+      {
+        const size_t index = static_cast<size_t>(ring) * scan.count() + column;
+        const double azimuth = scan.angle_min() + column * scan.angle_step();
+        const double depth = scan.ranges(index);
+        const float point[3] = {static_cast<float>(depth * std::cos(inclination) * std::cos(azimuth)),
+                                static_cast<float>(depth * std::cos(inclination) * std::sin(azimuth)),
+                                static_cast<float>(depth * std::sin(inclination))};
+        const float intensity = static_cast<float>(scan.intensities(index));
+        const uint16_t ring_index = static_cast<uint16_t>(ring);
+        char * out = &(*data)[index * 32];
+        std::memcpy(out, point, sizeof(point));
+        std::memcpy(out + 16, &intensity, sizeof(intensity));
+        std::memcpy(out + 20, &ring_index, sizeof(ring_index));
+      }
+    }
+    return cloud;
+  }
+
+  float readFloat(const sensor_msgs::msg::PointCloud2 & cloud, size_t index, uint32_t offset)
+  {
+    float value;
+    std::memcpy(&value, &cloud.data[index * cloud.point_step + offset], sizeof(value));
+    return value;
+  }
+
+  uint16_t readRing(const sensor_msgs::msg::PointCloud2 & cloud, size_t index)
+  {
+    uint16_t value;
+    std::memcpy(&value, &cloud.data[index * cloud.point_step + 20], sizeof(value));
+    return value;
+  }
+
+  // Finite coordinates within float rounding, and non finite ones of the same kind and sign
+  bool sameCoordinate(float projected, float expected)
+  {
+    if (std::isfinite(expected))
+    {
+      return std::fabs(projected - expected) <= 1e-5f * std::max(1.0f, std::fabs(expected));
+    }
+    if (std::isnan(expected))
+    {
+      return std::isnan(projected);
+    }
+    return projected == expected;
+  }
+}
+
+TEST(ScanProjectorTest, MatchesTheSimulatorCloud)
+{
+  const auto scan = syntheticScan();
+  sensor_msgs::msg::PointCloud2 expected;
+  ignition_platform::SensorStream<ignition::msgs::PointCloudPacked>::convert(gazeboCloud(scan), expected);
+
+  ignition_platform::ScanProjector projector;
+  sensor_msgs::msg::PointCloud2 projected;
+  projector.project(scan, projected);
+
+  ASSERT_EQ(projected.fields.size(), expected.fields.size());
+  for (size_t i = 0; i < expected.fields.size(); i++)
+  {
+    EXPECT_EQ(projected.fields[i].name, expected.fields[i].name);
+    EXPECT_EQ(projected.fields[i].offset, expected.fields[i].offset);
+    EXPECT_EQ(projected.fields[i].datatype, expected.fields[i].datatype);
+    EXPECT_EQ(projected.fields[i].count, expected.fields[i].count);
+  }
+  EXPECT_EQ(projected.header.stamp, expected.header.stamp);
+  EXPECT_EQ(projected.height, expected.height);
+  EXPECT_EQ(projected.width, expected.width);
+  EXPECT_EQ(projected.point_step, expected.point_step);
+  EXPECT_EQ(projected.row_step, expected.row_step);
+  EXPECT_EQ(projected.is_bigendian, expected.is_bigendian);
+  EXPECT_FALSE(projected.is_dense);
+  ASSERT_EQ(projected.data.size(), expected.data.size());
+
+  size_t mismatches = 0;
+  size_t non_finite = 0;
+  for (size_t i = 0; i < static_cast<size_t>(expected.width) * expected.height; i++)
+  {
+    bool same = readRing(projected, i) == readRing(expected, i) &&
+                readFloat(projected, i, 16) == readFloat(expected, i, 16);
+    for (uint32_t offset : {0u, 4u, 8u})
+    {
+      same = same && sameCoordinate(readFloat(projected, i, offset), readFloat(expected, i, offset));
+      non_finite += std::isfinite(readFloat(expected, i, offset)) ? 0 : 1;
+    }
+    mismatches += same ? 0 : 1;
+  }
+  EXPECT_EQ(mismatches, 0u);
+  // The rays without a return are in the comparison
+  EXPECT_GT(non_finite, 0u);
+}
+
+TEST(ScanProjectorTest, ShortScanLeavesRaysWithoutReturn)
+{
+  auto scan = syntheticScan();
+  scan.mutable_ranges()->Truncate(kColumns * kRings - kColumns - 3);
+  scan.mutable_intensities()->Truncate(kColumns * kRings - kColumns - 3);
+
+  ignition_platform::ScanProjector projector;
+  sensor_msgs::msg::PointCloud2 projected;
+  projector.project(scan, projected);
+
+  ASSERT_EQ(projected.height, kRings);
+  for (size_t i = scan.ranges_size(); i < kColumns * kRings; i++)
+  {
+    EXPECT_TRUE(std::isinf(readFloat(projected, i, 0)) && std::isinf(readFloat(projected, i, 4)) &&
+                std::isinf(readFloat(projected, i, 8)));
+    EXPECT_EQ(readRing(projected, i), i / kColumns);
+  }
+}
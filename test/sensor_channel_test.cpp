@@ -0,0 +1,189 @@
+/*!*******************************************************************************************
+ *  \file       sensor_channel_test.cpp
+ *  \brief      Bytes copied and buffer reuse of the sensor channels
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// The camera and point cloud payloads are copied once, by the conversion into the buffer kept by
+// their channel, and that buffer is what the platform publishes. The platform callbacks are
+// replaced by callbacks checking that they get the channel buffer, so what is measured here is
+// everything the bridge does per frame.
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#include "allocation_counter.hpp"
+#include "sensor_channel.hpp"
+
+namespace
+{
+  using ignition_platform::SensorStats;
+  using ignition_platform::makeSensorChannel;
+  using ignition_platform::test::AllocationScope;
+
+  constexpr int kFrames = 100;
+
+  ignition::msgs::Image syntheticImage(uint32_t width, uint32_t height)
+  {
+    ignition::msgs::Image image;
+    image.set_width(width);
+    image.set_height(height);
+    image.set_step(width * 3);
+    image.set_pixel_format_type(ignition::msgs::PixelFormatType::RGB_INT8);
+    image.mutable_header()->mutable_stamp()->set_sec(1);
+    auto * frame = image.mutable_header()->add_data();
+    frame->set_key("frame_id");
+    frame->add_value("drone0::camera::camera_link::camera");
+    std::string * data = image.mutable_data();
+    data->resize(static_cast<size_t>(width) * height * 3);
+    for (size_t i = 0; i < data->size(); i++)
+    {
+      (*data)[i] = static_cast<char>(i * 31);
+    }
+    return image;
+  }
+
+  ignition::msgs::PointCloudPacked syntheticCloud(uint32_t width, uint32_t height)
+  {
+    ignition::msgs::PointCloudPacked cloud;
+    cloud.set_width(width);
+    cloud.set_height(height);
+    cloud.set_point_step(16);
+    cloud.set_row_step(width * 16);
+    cloud.set_is_dense(false);
+    for (const char * name : {"x", "y", "z", "intensity"})
+    {
+      auto * field = cloud.add_field();
+      field->set_name(name);
+      field->set_offset(4 * (cloud.field_size() - 1));
+      field->set_datatype(ignition::msgs::PointCloudPacked::Field::FLOAT32);
+      field->set_count(1);
+    }
+    cloud.mutable_data()->resize(static_cast<size_t>(width) * height * 16, '\x01');
+    return cloud;
+  }
+
+  template <typename IgnMsgT, typename RosMsgT>
+  void expectPayloadCopiedOnce(const IgnMsgT & msg, const std::string & payload,
+                               const std::string & name)
+  {
+    const RosMsgT * delivered = nullptr;
+    const uint8_t * delivered_data = nullptr;
+    size_t delivered_frames = 0;
+    auto stats = std::make_shared<SensorStats>();
+    auto channel = makeSensorChannel<IgnMsgT>(
+      [&](RosMsgT & ros_msg)
+      {
+        // Every frame reaches the callback in the same buffer, so publishing it copies nothing
+        if (delivered)
+        {
+          EXPECT_EQ(delivered, &ros_msg);
+          EXPECT_EQ(delivered_data, ros_msg.data.data());
+        }
+        delivered = &ros_msg;
+        delivered_data = ros_msg.data.data();
+        delivered_frames++;
+      },
+      stats);
+
+    // The first frame sizes the buffer
+    (*channel)(msg);
+    ASSERT_NE(delivered, nullptr);
+    ASSERT_EQ(delivered->data.size(), payload.size());
+    EXPECT_EQ(0, std::memcmp(delivered->data.data(), payload.data(), payload.size()));
+
+    AllocationScope allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kFrames; i++)
+    {
+      (*channel)(msg);
+    }
+    const double ns_per_frame = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / kFrames;
+
+    EXPECT_EQ(delivered_frames, static_cast<size_t>(kFrames) + 1);
+    EXPECT_EQ(stats->published.load(), static_cast<uint64_t>(kFrames) + 1);
+    // The payload is not reallocated, so the only copy of it is the one written by the conversion
+    EXPECT_LT(allocations.count().bytes, payload.size());
+    ::testing::Test::RecordProperty(name + "_payload_bytes", static_cast<int>(payload.size()));
+    ::testing::Test::RecordProperty(name + "_bytes_copied_per_frame", static_cast<int>(payload.size()));
+    ::testing::Test::RecordProperty(name + "_ns_per_frame", static_cast<int>(ns_per_frame));
+  }
+}
+
+TEST(SensorChannelTest, ImagePayloadCopiedOnceIntoReusedBuffer)
+{
+  const auto image = syntheticImage(1920, 1080);
+  expectPayloadCopiedOnce<ignition::msgs::Image, sensor_msgs::msg::Image>(image, image.data(), "image");
+}
+
+TEST(SensorChannelTest, PointCloudPayloadCopiedOnceIntoReusedBuffer)
+{
+  const auto cloud = syntheticCloud(2048, 64);
+  expectPayloadCopiedOnce<ignition::msgs::PointCloudPacked, sensor_msgs::msg::PointCloud2>(
+    cloud, cloud.data(), "point_cloud");
+}
+
+TEST(SensorChannelTest, ResizedImageReusesBuffer)
+{
+  // A smaller frame keeps the capacity, and a larger one grows it once
+  size_t capacity = 0;
+  auto channel = makeSensorChannel<ignition::msgs::Image>(
+    [&capacity](sensor_msgs::msg::Image & ros_msg) { capacity = ros_msg.data.capacity(); },
+    std::make_shared<SensorStats>());
+
+  (*channel)(syntheticImage(640, 480));
+  const size_t vga_capacity = capacity;
+  (*channel)(syntheticImage(320, 240));
+  EXPECT_EQ(capacity, vga_capacity);
+  (*channel)(syntheticImage(1280, 720));
+  EXPECT_GE(capacity, 1280u * 720u * 3u);
+}
+
+TEST(SensorChannelTest, ReusedPointCloudKeepsItsFields)
+{
+  size_t fields = 0;
+  auto channel = makeSensorChannel<ignition::msgs::PointCloudPacked>(
+    [&fields](sensor_msgs::msg::PointCloud2 & ros_msg) { fields = ros_msg.fields.size(); },
+    std::make_shared<SensorStats>());
+
+  const auto cloud = syntheticCloud(16, 1);
+  for (int i = 0; i < 3; i++)
+  {
+    (*channel)(cloud);
+  }
+  EXPECT_EQ(fields, 4u);
+}
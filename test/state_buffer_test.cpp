@@ -0,0 +1,175 @@
+/*!*******************************************************************************************
+ *  \file       state_buffer_test.cpp
+ *  \brief      Concurrent stress test of the vehicle state sequence lock
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// One writer stores states whose fields are all derived from the same counter while several
+// readers load them, as the odometry callback and the command path do. A torn read shows up as
+// fields from different stores. Built with IGNITION_PLATFORM_TSAN, ThreadSanitizer also checks
+// that the handoff has no data race.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "state_buffer.hpp"
+
+namespace
+{
+  // Same size and layout as VehicleState
+  struct State
+  {
+    double position[3];
+    double orientation[4];
+    double linear_velocity[3];
+    double angular_velocity[3];
+    int32_t stamp_sec;
+    uint32_t stamp_nanosec;
+  };
+
+  State makeState(uint64_t i)
+  {
+    State state;
+    const double value = static_cast<double>(i);
+    for (double & field : state.position)
+    {
+      field = value;
+    }
+    for (double & field : state.orientation)
+    {
+      field = -value;
+    }
+    for (double & field : state.linear_velocity)
+    {
+      field = 2.0 * value;
+    }
+    for (double & field : state.angular_velocity)
+    {
+      field = value + 0.5;
+    }
+    state.stamp_sec = static_cast<int32_t>(i);
+    state.stamp_nanosec = static_cast<uint32_t>(i * 7);
+    return state;
+  }
+
+  bool consistent(const State & state)
+  {
+    const uint64_t i = static_cast<uint64_t>(state.stamp_sec);
+    const State expected = makeState(i);
+    return std::memcmp(&state, &expected, sizeof(State)) == 0;
+  }
+}
+
+TEST(StateBufferTest, NothingStoredReadsSequenceZero)
+{
+  ignition_platform::StateBuffer<State> buffer;
+  State state;
+  EXPECT_EQ(buffer.load(state), 0u);
+  EXPECT_EQ(buffer.sequence(), 0u);
+
+  buffer.store(makeState(3));
+  EXPECT_EQ(buffer.load(state), 1u);
+  EXPECT_TRUE(consistent(state));
+  EXPECT_EQ(state.stamp_sec, 3);
+}
+
+TEST(StateBufferTest, ConcurrentReadersNeverSeeTornStates)
+{
+  constexpr uint64_t kStores = 200000;
+  constexpr int kReaders = 3;
+
+  ignition_platform::StateBuffer<State> buffer;
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> torn{0};
+  std::atomic<uint64_t> out_of_order{0};
+  std::atomic<uint64_t> loads{0};
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < kReaders; r++)
+  {
+    readers.emplace_back(
+      [&]()
+      {
+        uint64_t last_sequence = 0;
+        int32_t last_stamp = -1;
+        State state;
+        while (!done.load(std::memory_order_relaxed))
+        {
+          const uint64_t sequence = buffer.load(state);
+          loads.fetch_add(1, std::memory_order_relaxed);
+          if (sequence == 0)
+          {
+            continue;
+          }
+          if (!consistent(state))
+          {
+            torn.fetch_add(1, std::memory_order_relaxed);
+          }
+          // Sequences and the states behind them only move forward
+          if (sequence < last_sequence || state.stamp_sec < last_stamp)
+          {
+            out_of_order.fetch_add(1, std::memory_order_relaxed);
+          }
+          last_sequence = sequence;
+          last_stamp = state.stamp_sec;
+        }
+      });
+  }
+
+  std::thread writer(
+    [&]()
+    {
+      for (uint64_t i = 1; i <= kStores; i++)
+      {
+        buffer.store(makeState(i));
+      }
+    });
+  writer.join();
+  done.store(true, std::memory_order_relaxed);
+  for (auto & reader : readers)
+  {
+    reader.join();
+  }
+
+  EXPECT_EQ(buffer.sequence(), kStores);
+  State last;
+  buffer.load(last);
+  EXPECT_EQ(last.stamp_sec, static_cast<int32_t>(kStores));
+  EXPECT_EQ(torn.load(), 0u);
+  EXPECT_EQ(out_of_order.load(), 0u);
+  EXPECT_GT(loads.load(), 0u);
+}
@@ -0,0 +1,209 @@
+/*!*******************************************************************************************
+ *  \file       steady_state_allocation_test.cpp
+ *  \brief      Steady state allocations of the small sensor streams and commands
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+// Once the first message has sized the buffers, the IMU, air pressure, magnetometer, GPS, pose and
+// odometry streams and the twist command make no heap allocation per message. The sensor streams
+// are driven through their channels. Pose, odometry and twist go through an IgnitionBridge and an
+// in-process ignition node, so they are compared with ignition on its own: publishing the same
+// message on a topic of the same length to a subscriber that does nothing.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "allocation_counter.hpp"
+#include "ignition_bridge.hpp"
+#include "sensor_channel.hpp"
+
+namespace
+{
+  using ignition_platform::SensorStats;
+  using ignition_platform::makeSensorChannel;
+  using ignition_platform::test::AllocationScope;
+
+  constexpr int kMessages = 1000;
+  const std::string kNamespace = "/drone0";
+  // Same length as the topics of kNamespace
+  const std::string kBaselineNamespace = "/drone1";
+
+  // Allocations made by the calling thread over kMessages calls, after a first call that sizes the
+  // buffers
+  template <typename Work>
+  uint64_t steadyStateAllocations(Work && work)
+  {
+    work();
+    AllocationScope allocations;
+    for (int i = 0; i < kMessages; i++)
+    {
+      work();
+    }
+    return allocations.count().allocations;
+  }
+
+  void setFrame(ignition::msgs::Header * header, const std::string & frame_id,
+                const std::string & child_frame_id = "")
+  {
+    header->mutable_stamp()->set_sec(1);
+    auto * frame = header->add_data();
+    frame->set_key("frame_id");
+    frame->add_value(frame_id);
+    if (!child_frame_id.empty())
+    {
+      auto * child_frame = header->add_data();
+      child_frame->set_key("child_frame_id");
+      child_frame->add_value(child_frame_id);
+    }
+  }
+
+  template <typename IgnMsgT>
+  uint64_t channelAllocations(const IgnMsgT & msg)
+  {
+    auto channel = makeSensorChannel<IgnMsgT>(
+      [](typename ignition_platform::SensorStream<IgnMsgT>::RosMsg &) {}, std::make_shared<SensorStats>());
+    return steadyStateAllocations([&]() { (*channel)(msg); });
+  }
+
+  // Allocations of publishing msg to the bridge on topic, minus those of ignition alone delivering
+  // it on the same topic of another model. In-process callbacks run on the publishing thread,
+  // which is where allocations are counted, and the callbacks check that they do.
+  template <typename IgnMsgT>
+  int64_t bridgeAllocations(const std::string & topic, const IgnMsgT & msg,
+                            const std::atomic<bool> & delivered_here)
+  {
+    ignition::transport::Node node;
+    const std::string baseline_topic = "model" + kBaselineNamespace + topic;
+    std::atomic<bool> baseline_here{false};
+    const auto test_thread = std::this_thread::get_id();
+    node.Subscribe<IgnMsgT>(
+      baseline_topic, [&baseline_here, test_thread](const IgnMsgT &)
+      { baseline_here = std::this_thread::get_id() == test_thread; });
+    auto baseline_publisher = node.Advertise<IgnMsgT>(baseline_topic);
+    auto publisher = node.Advertise<IgnMsgT>("model" + kNamespace + topic);
+
+    const uint64_t baseline = steadyStateAllocations([&]() { baseline_publisher.Publish(msg); });
+    const uint64_t bridged = steadyStateAllocations([&]() { publisher.Publish(msg); });
+    EXPECT_TRUE(baseline_here.load());
+    EXPECT_TRUE(delivered_here.load());
+    return static_cast<int64_t>(bridged) - static_cast<int64_t>(baseline);
+  }
+}
+
+TEST(SteadyStateAllocationTest, ImuChannel)
+{
+  ignition::msgs::IMU imu;
+  setFrame(imu.mutable_header(), "drone0::imu::imu_link::imu");
+  imu.mutable_orientation()->set_w(1.0);
+  imu.mutable_linear_acceleration()->set_z(9.81);
+  EXPECT_EQ(channelAllocations(imu), 0u);
+}
+
+TEST(SteadyStateAllocationTest, AirPressureChannel)
+{
+  ignition::msgs::FluidPressure pressure;
+  setFrame(pressure.mutable_header(), "drone0::air_pressure::base_link::air_pressure");
+  pressure.set_pressure(101325.0);
+  EXPECT_EQ(channelAllocations(pressure), 0u);
+}
+
+TEST(SteadyStateAllocationTest, MagnetometerChannel)
+{
+  ignition::msgs::Magnetometer magnetometer;
+  setFrame(magnetometer.mutable_header(), "drone0::magnetometer::base_link::magnetometer");
+  magnetometer.mutable_field_tesla()->set_x(2e-5);
+  EXPECT_EQ(channelAllocations(magnetometer), 0u);
+}
+
+TEST(SteadyStateAllocationTest, NavSatChannel)
+{
+  ignition::msgs::NavSat navsat;
+  setFrame(navsat.mutable_header(), "drone0::gps::gps_link::gps");
+  navsat.set_frame_id("drone0::gps::gps_link::gps");
+  navsat.set_latitude_deg(40.4);
+  navsat.set_longitude_deg(-3.7);
+  EXPECT_EQ(channelAllocations(navsat), 0u);
+}
+
+TEST(SteadyStateAllocationTest, OdometryHandler)
+{
+  ignition_platform::IgnitionBridge bridge(kNamespace);
+  std::atomic<bool> delivered_here{false};
+  const auto test_thread = std::this_thread::get_id();
+  bridge.setOdometryCallback([&delivered_here, test_thread](nav_msgs::msg::Odometry &)
+                             { delivered_here = std::this_thread::get_id() == test_thread; });
+
+  ignition::msgs::Odometry odometry;
+  setFrame(odometry.mutable_header(), "drone0/odom", "drone0");
+  odometry.mutable_pose()->mutable_orientation()->set_w(1.0);
+  odometry.mutable_twist()->mutable_linear()->set_x(1.0);
+  EXPECT_EQ(bridgeAllocations("/odometry", odometry, delivered_here), 0);
+}
+
+TEST(SteadyStateAllocationTest, PoseHandler)
+{
+  ignition_platform::IgnitionBridge bridge(kNamespace);
+  std::atomic<bool> delivered_here{false};
+  const auto test_thread = std::this_thread::get_id();
+  bridge.setPoseCallback([&delivered_here, test_thread](geometry_msgs::msg::PoseStamped &)
+                         { delivered_here = std::this_thread::get_id() == test_thread; });
+
+  ignition::msgs::Pose pose;
+  setFrame(pose.mutable_header(), "earth", "drone0");
+  pose.mutable_position()->set_z(1.5);
+  pose.mutable_orientation()->set_w(1.0);
+  EXPECT_EQ(bridgeAllocations("/pose", pose, delivered_here), 0);
+}
+
+TEST(SteadyStateAllocationTest, TwistCommand)
+{
+  // Nothing subscribes to either command topic, so ignition does the same work for both
+  ignition_platform::IgnitionBridge bridge(kNamespace);
+  ignition::transport::Node node;
+  auto baseline_publisher = node.Advertise<ignition::msgs::Twist>("model" + kBaselineNamespace + "/cmd_vel");
+  ignition::msgs::Twist baseline_twist;
+
+  geometry_msgs::msg::Twist twist;
+  twist.linear.x = 1.0;
+  twist.angular.z = 0.5;
+  const uint64_t baseline = steadyStateAllocations(
+    [&]()
+    {
+      ros_ign_bridge::convert_ros_to_ign(twist, baseline_twist);
+      baseline_publisher.Publish(baseline_twist);
+    });
+  EXPECT_EQ(steadyStateAllocations([&]() { bridge.sendTwistMsg(twist); }), baseline);
+}